@@ -13,10 +13,8 @@
 #include <mutex>
 #include <cmath>
 #include <iostream>
-#include <chrono>
 
 using namespace std;
-using namespace std::chrono;
 
 namespace {
 // work around bug in ALE.
@@ -24,15 +22,6 @@ namespace {
 mutex ALE_GLOBAL_LOCK;
 }
 
-static long compute_seed(int v) {
-  auto now = system_clock::now();
-  auto now_ms = time_point_cast<milliseconds>(now);
-  auto value = now_ms.time_since_epoch();
-  long duration = value.count();
-  long seed = (time(NULL) * 1000 + duration) % 100000000 + v;
-  return seed;
-}
-
 void AtariGameSummary::Feed(reward_t last_reward) {
   _accu_reward += last_reward;
 }
@@ -57,13 +46,12 @@ void AtariGameSummary::Print() const {
     std::cout << " current accumulated reward: " << _accu_reward << std::endl;
 }
 
-AtariGame::AtariGame(const GameOptions& opt)
+AtariGame::AtariGame(const GameOptions& opt, int ale_seed)
   : _h(opt.hist_len), _reward_clip(opt.reward_clip), _eval_only(opt.eval_only) {
   lock_guard<mutex> lg(ALE_GLOBAL_LOCK);
   _ale.reset(new ALEInterface);
-  long seed = compute_seed(opt.seed);
-  // std::cout << "Seed: " << seed << std::endl;
-  _ale->setInt("random_seed", seed);
+  // std::cout << "Seed: " << ale_seed << std::endl;
+  _ale->setInt("random_seed", ale_seed);
   _ale->setBool("showinfo", false);
   // _ale->setInt("frame_skip", opt.frame_skip);
   _ale->setBool("color_averaging", false);
@@ -81,9 +69,8 @@ void AtariGame::MainLoop(const std::atomic_bool& done) {
   assert(_game_idx >= 0);  // init_comm has been called
 
   // Add some random actions.
-  long seed = compute_seed(_game_idx);
   std::default_random_engine g;
-  g.seed(seed);
+  g.seed(_seed);
   std::uniform_int_distribution<int> distr_start_loc(0, 0);
   std::uniform_int_distribution<int> distr_frame_skip(2, 4);
 
@@ -38,6 +38,7 @@ using AIComm = AICommT<Comm>;
 class AtariGame {
   private:
     int _game_idx = -1;
+    int _seed = 0;
     AIComm *_ai_comm;
     std::unique_ptr<ALEInterface> _ale;
 
@@ -70,11 +71,13 @@ class AtariGame {
     void _copy_screen(GameState &);
 
   public:
-    AtariGame(const GameOptions&);
+    // ale_seed seeds the emulator; initialize_comm() gives the seed of the random start actions.
+    AtariGame(const GameOptions&, int ale_seed);
 
-    void initialize_comm(int game_idx, AIComm* ai_comm) {
+    void initialize_comm(int game_idx, int seed, AIComm* ai_comm) {
       _ai_comm = ai_comm;
       _game_idx = game_idx;
+      _seed = seed;
     }
 
     void MainLoop(const std::atomic_bool& done);
@@ -32,7 +32,8 @@ class GameContext {
       _hist_len = options.hist_len;
 
       for (int i = 0; i < context_options.num_games; ++i) {
-        games.emplace_back(options);
+        // options.seed != 0 overrides the seeds derived from the base seed.
+        games.emplace_back(options, options.seed == 0 ? _context->context_options().game_seed(i, 1) : options.seed + i);
         if (i == 0) {
           auto& game = games.back();
           _width = game.width(), _height = game.height(), _num_action = game.num_actions();
@@ -48,7 +49,7 @@ class GameContext {
     }
 
     void Start() {
-        auto f = [this](int game_idx, const ContextOptions &context_options, const GameOptions&,
+        auto f = [this](int game_idx, const ContextOptions &context_options, const GameOptions& options,
                 const elf::Signal& signal, GC::Comm* comm) {
             GC::AIComm ai_comm(game_idx, comm);
             auto &state = ai_comm.info().data;
@@ -57,7 +58,8 @@ class GameContext {
                 s.Init(game_idx, _num_action);
             }
             auto& game = games[game_idx];
-            game.initialize_comm(game_idx, &ai_comm);
+            int seed = (options.seed == 0 ? context_options.game_seed(game_idx) : options.seed + game_idx);
+            game.initialize_comm(game_idx, seed, &ai_comm);
             game.MainLoop(signal.done());
         };
         _context->Start(f);
@@ -0,0 +1,189 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace elf {
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}. Throws std::range_error on a malformed list.
+inline std::vector<int> ParseCpuList(const std::string &s) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos) end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty() || item == "\n") continue;
+
+        size_t dash = item.find('-');
+        try {
+            int first = std::stoi(item.substr(0, dash));
+            int last = (dash == std::string::npos ? first : std::stoi(item.substr(dash + 1)));
+            if (first < 0 || last < first) throw std::invalid_argument(item);
+            for (int c = first; c <= last; ++c) cpus.push_back(c);
+        } catch (const std::logic_error &) {
+            throw std::range_error("Invalid cpu list " + s);
+        }
+    }
+    return cpus;
+}
+
+// CPUs of each NUMA node, from sysfs. A single node with all CPUs if there is no NUMA information.
+inline std::vector<std::vector<int>> NumaNodeCpus() {
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0; ; ++node) {
+        std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string line;
+        if (! f || ! std::getline(f, line)) break;
+        nodes.push_back(ParseCpuList(line));
+    }
+    if (nodes.empty()) {
+        std::vector<int> cpus;
+        for (int c = 0; c < (int)std::max(1u, std::thread::hardware_concurrency()); ++c) cpus.push_back(c);
+        nodes.push_back(cpus);
+    }
+    return nodes;
+}
+
+// Pin the calling thread to cpus.
+inline bool SetThreadAffinity(const std::vector<int> &cpus) {
+#ifdef __linux__
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) {
+        if (c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// Move the pages fully inside [p, p + size) to NUMA node, and keep them there.
+inline bool BindMemoryToNode(void *p, size_t size, int node) {
+#ifdef __linux__
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)p + page - 1) / page * page;
+    uintptr_t end = ((uintptr_t)p + size) / page * page;
+    // Less than a page, nothing to move.
+    if (end <= begin) return true;
+
+    const size_t bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(node / bits + 1, 0);
+    mask[node / bits] = 1UL << (node % bits);
+    return syscall(SYS_mbind, begin, end - begin, MPOL_BIND, mask.data(), mask.size() * bits + 1, MPOL_MF_MOVE) == 0;
+#else
+    return false;
+#endif
+}
+
+// Where game and collector threads run, from ContextOptions::thread_affinity:
+//   ""         no pinning.
+//   "compact"  consecutive CPUs, filling a NUMA node before the next.
+//   "scatter"  CPUs round robin over the NUMA nodes.
+//   "numa"     game i and collector group g may use any CPU of node i % #nodes and g % #nodes.
+//   "0-7,16"   CPUs from this list, in order.
+// Except for "numa", each game gets cpus_per_game CPUs in a row and each collector one CPU.
+// Threads a game starts (e.g. its tree search pool) inherit its CPU set, so cpus_per_game should
+// cover them. Games take CPUs from the front and collectors from the back of the order, and wrap
+// around if there are more threads than CPUs.
+class ThreadAffinity {
+public:
+    explicit ThreadAffinity(const std::string &spec = "", int cpus_per_game = 1)
+        : _spec(spec), _cpus_per_game(std::max(1, cpus_per_game)) {
+        if (spec.empty()) return;
+
+        _nodes = NumaNodeCpus();
+        if (spec == "numa") return;
+
+        if (spec == "compact") {
+            for (const auto &cpus : _nodes) _order.insert(_order.end(), cpus.begin(), cpus.end());
+        } else if (spec == "scatter") {
+            for (size_t i = 0; ; ++i) {
+                bool added = false;
+                for (const auto &cpus : _nodes) {
+                    if (i < cpus.size()) {
+                        _order.push_back(cpus[i]);
+                        added = true;
+                    }
+                }
+                if (! added) break;
+            }
+        } else {
+            _order = ParseCpuList(spec);
+        }
+        if (_order.empty()) throw std::range_error("No CPU for thread affinity " + spec);
+    }
+
+    bool enabled() const { return ! _spec.empty(); }
+    const std::string &spec() const { return _spec; }
+
+    std::vector<int> GameCpus(int game_idx) const {
+        if (! enabled()) return std::vector<int>();
+        if (_order.empty()) return _nodes[game_idx % _nodes.size()];
+        std::vector<int> cpus;
+        for (int k = 0; k < _cpus_per_game && k < (int)_order.size(); ++k) {
+            cpus.push_back(_order[((size_t)game_idx * _cpus_per_game + k) % _order.size()]);
+        }
+        return cpus;
+    }
+
+    std::vector<int> CollectorCpus(int gid) const {
+        if (! enabled()) return std::vector<int>();
+        if (_order.empty()) return _nodes[gid % _nodes.size()];
+        return { _order[_order.size() - 1 - gid % _order.size()] };
+    }
+
+    // NUMA node the collector runs on, -1 if it is not pinned.
+    int CollectorNode(int gid) const {
+        std::vector<int> cpus = CollectorCpus(gid);
+        if (cpus.empty()) return -1;
+        for (size_t node = 0; node < _nodes.size(); ++node) {
+            if (std::find(_nodes[node].begin(), _nodes[node].end(), cpus[0]) != _nodes[node].end()) return node;
+        }
+        return -1;
+    }
+
+    void PinGame(int game_idx) const { pin(GameCpus(game_idx), "game", game_idx); }
+    void PinCollector(int gid) const { pin(CollectorCpus(gid), "collector", gid); }
+
+private:
+    std::string _spec;
+    int _cpus_per_game;
+    std::vector<std::vector<int>> _nodes;
+    // CPU of each thread, empty for "numa".
+    std::vector<int> _order;
+
+    void pin(const std::vector<int> &cpus, const char *kind, int idx) const {
+        if (cpus.empty()) return;
+        if (! SetThreadAffinity(cpus)) {
+            std::cout << "Cannot set the thread affinity of " << kind << " " << idx << " (" << _spec << ")" << std::endl;
+        }
+    }
+};
+
+}  // namespace elf
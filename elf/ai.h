@@ -79,6 +79,23 @@ public:
         return true;
     }
 
+    // Act() in two halves. Several AIs can send before any of them waits, so the requests land in the same batch.
+    bool ActSend(const S &s, const std::atomic_bool *done) {
+        assert(_ai_comm);
+        before_act(s, done);
+        _ai_comm->Prepare();
+        Data *data = &_ai_comm->info().data;
+        extract(s, data);
+        return _ai_comm->SendData();
+    }
+
+    bool ActWaitReply(const S &s, A *a) {
+        assert(_ai_comm);
+        if (! _ai_comm->WaitReply()) return false;
+        if (a != nullptr) handle_response(s, _ai_comm->info().data, a);
+        return true;
+    }
+
     const Data& data() const {
         assert(_ai_comm);
         return _ai_comm->info().data;
@@ -167,6 +184,23 @@ public:
         return true;
     }
 
+    // Act() in two halves, for games that do not block between sending and getting the reply.
+    bool ActSend(const std::atomic_bool *done) {
+        assert(_ai_comm);
+        before_act(done);
+        _ai_comm->Prepare();
+        Data *data = &_ai_comm->info().data;
+        extract(data);
+        return _ai_comm->SendData();
+    }
+
+    bool ActWaitReply(A *a) {
+        assert(_ai_comm);
+        if (! _ai_comm->WaitReply()) return false;
+        if (a != nullptr) handle_response(_ai_comm->info().data, a);
+        return true;
+    }
+
     const Data& data() const {
         assert(_ai_comm);
         return _ai_comm->info().data;
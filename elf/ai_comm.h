@@ -9,6 +9,7 @@
 #pragma once
 #include "common.h"
 
+#include <chrono>
 #include <random>
 
 // Game information
@@ -25,6 +26,9 @@ struct InfoT {
     // Prepare(SeqInfo), initialize everything.
     Data data;
 
+    // When data was last sent to the collectors.
+    std::chrono::steady_clock::time_point sent_at;
+
     InfoT(int id) : meta(id) { }
     InfoT(const InfoT<Data> &parent, int child_id) 
         : meta(parent.meta, child_id), data(parent.data) { }
@@ -48,6 +52,9 @@ private:
     Info _info;
     SeqInfo _curr_seq;
 
+    // Groups the last SendData went to.
+    std::vector<int> _selected_groups;
+
     std::mt19937 _g;
 
 public:
@@ -88,6 +95,18 @@ public:
         // std::cout << "[" << _meta.id << "] Done with SendDataWaitReply, continue" << std::endl;
     }
 
+    // Split version of SendDataWaitReply, so that several AIComms can be in flight from one thread.
+    bool SendData() {
+        return _comm->SendData(_info.meta.query_id, _info, &_selected_groups);
+    }
+
+    // False if the comm is stopped before the reply came.
+    bool WaitReply() {
+        bool replied = _comm->WaitReply(_info.meta.query_id, _selected_groups);
+        _selected_groups.clear();
+        return replied;
+    }
+
     void Restart() {
         // std::cout << "[" << _info.meta.id << "] Restarting" << std::endl;
         _info.data.Restart();
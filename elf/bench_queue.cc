@@ -0,0 +1,105 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+// Compare moodycamel::BlockingConcurrentQueue, the spinning TBB queue and EventQueue:
+//   idle CPU: consumers wait on an empty queue, report the CPU time they burn.
+//   wake latency: a consumer waits, the producer pushes the current time, report the delay until pop.
+// Build with -DELF_BUILD_BENCH=ON, then run ./elf/bench_queue in the build directory.
+
+#include "event_queue.h"
+#include "blockingconcurrentqueue.h"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// The TBB queue as used by pop_wait() without USE_EVENT_QUEUE.
+template <typename T>
+class SpinQueue {
+public:
+    bool enqueue(const T &val) { _q.push(val); return true; }
+    void wait_dequeue(T &val) {
+        while (! _q.try_pop(val)) { }
+    }
+
+private:
+    tbb::concurrent_queue<T> _q;
+};
+
+static double cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+template <typename Q>
+static double idle_cpu(int num_consumers, int wait_ms) {
+    Q q;
+    vector<thread> threads;
+    double start = cpu_seconds();
+    for (int i = 0; i < num_consumers; ++i) {
+        threads.emplace_back([&]() {
+            Clock::rep v;
+            q.wait_dequeue(v);
+        });
+    }
+    this_thread::sleep_for(chrono::milliseconds(wait_ms));
+    double used = cpu_seconds() - start;
+    for (int i = 0; i < num_consumers; ++i) q.enqueue(0);
+    for (auto &t : threads) t.join();
+    // In cores.
+    return used / (wait_ms * 1e-3);
+}
+
+template <typename Q>
+static void wake_latency(int num_rounds, int gap_usec, double *median, double *p99) {
+    Q q;
+    vector<double> latency;
+    thread consumer([&]() {
+        Clock::rep t = 0;
+        for (int i = 0; i < num_rounds; ++i) {
+            q.wait_dequeue(t);
+            latency.push_back((Clock::now().time_since_epoch().count() - t) * 1e-3);
+        }
+    });
+    for (int i = 0; i < num_rounds; ++i) {
+        // Let the consumer go idle first.
+        this_thread::sleep_for(chrono::microseconds(gap_usec));
+        q.enqueue(Clock::now().time_since_epoch().count());
+    }
+    consumer.join();
+
+    sort(latency.begin(), latency.end());
+    *median = latency[latency.size() / 2];
+    *p99 = latency[latency.size() * 99 / 100];
+}
+
+template <typename Q>
+static void run(const string &name, int num_consumers) {
+    double cores = idle_cpu<Q>(num_consumers, 1000);
+
+    double median, p99;
+    wake_latency<Q>(2000, 500, &median, &p99);
+
+    cout << name << ": idle " << num_consumers << " consumers use " << cores << " cores, "
+         << "wake latency median " << median << "us, p99 " << p99 << "us" << endl;
+}
+
+int main() {
+    const int num_consumers = 256;
+    run<moodycamel::BlockingConcurrentQueue<Clock::rep>>("BlockingConcurrentQueue", num_consumers);
+    // Spinning consumers would starve the producer, keep one core free.
+    run<SpinQueue<Clock::rep>>("tbb::concurrent_queue (spin)", max<int>(thread::hardware_concurrency() - 1, 1));
+    run<EventQueue<Clock::rep>>("EventQueue", num_consumers);
+    return 0;
+}
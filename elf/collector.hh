@@ -16,9 +16,15 @@
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <algorithm>
+#include <chrono>
 
 #include "lib/debugutils.hh"
-#ifdef USE_TBB
+#include "key_index.h"
+#include "primitive.h"
+#ifdef USE_EVENT_QUEUE
+#include "event_queue.h"
+#elif defined(USE_TBB)
 #include <tbb/concurrent_queue.h>
 #else
 #include "blockingconcurrentqueue.h"
@@ -29,13 +35,15 @@ namespace elf {
 
 template <typename Key, typename Value>
 class CollectorWithCCQueue {
-#ifdef USE_TBB
+#ifdef USE_EVENT_QUEUE
+  EventQueue<int> Q;
+#elif defined(USE_TBB)
   tbb::concurrent_queue<int> Q;
 #else
   moodycamel::BlockingConcurrentQueue<int> Q;
 #endif
 
-  std::unordered_map<Key, int> _index_map;
+  KeyIndex<Key> _index;
 
   struct TaskData {
     Value* val = nullptr;
@@ -47,13 +55,21 @@ class CollectorWithCCQueue {
   };
   std::vector<std::unique_ptr<TaskData>> _data;
 
+  const CancelToken *_cancel = nullptr;
+
+  // Queued by sendStop(). Not the index of any key, so it never touches a game's data.
+  static constexpr int kStopIndex = -1;
+
+  Value *value_of(int index) const { return index == kStopIndex ? nullptr : _data[index]->val; }
+
+  bool stopped() const { return _cancel != nullptr && _cancel->cancelled(); }
+
   int get_index(const Key &key) const {
-    auto it = _index_map.find(key);
-    if (it == _index_map.end()) {
+    int index = _index.Find(key);
+    if (index < 0) {
         std::cout << "key [" << key << "] not found! this should never happen! " << std::endl;
-        return -1;
     }
-    return it->second;
+    return index;
   }
 
   inline void notify(std::unique_ptr<TaskData>& d) {
@@ -63,28 +79,47 @@ class CollectorWithCCQueue {
   }
 
   public:
-  explicit CollectorWithCCQueue(const std::vector<Key> &keys) {
+  explicit CollectorWithCCQueue(const std::vector<Key> &keys) : _index(keys) {
       // Preload all the keys.
       for (size_t i = 0; i < keys.size(); ++i) {
           _data.emplace_back(new TaskData{});
-          _index_map.emplace(keys[i], i);
       }
   }
 
   CollectorWithCCQueue(const CollectorWithCCQueue&) = delete;
 
+  // Waits for replies return false once token is cancelled.
+  void setCancel(CancelToken *token) {
+    _cancel = token;
+    token->OnCancel([this]() {
+      for (auto& d: _data) {
+        std::lock_guard<std::mutex> lg(d->mutex);
+        d->cond.notify_all();
+      }
+    });
+  }
+
   void sendData(const Key& key, Value* value) {
     int index = get_index(key);
     if (index < 0) throw std::range_error("[sendData] key " + std::to_string(key) + " not found!");
 
     _data[index]->val = value;
-#ifdef USE_TBB
+#if defined(USE_TBB) && !defined(USE_EVENT_QUEUE)
     Q.push(index);
 #else
     Q.enqueue(index);
 #endif
   }
 
+  // Wake up the consumer with a nullptr value, e.g. to stop it.
+  void sendStop() {
+#if defined(USE_TBB) && !defined(USE_EVENT_QUEUE)
+    Q.push(kStopIndex);
+#else
+    Q.enqueue(kStopIndex);
+#endif
+  }
+
   void signalReply(const Key& key) {
     int index = get_index(key);
     if (index < 0) throw std::range_error("[signalReply] key " + std::to_string(key) + " not found!");
@@ -93,48 +128,48 @@ class CollectorWithCCQueue {
     notify(data);
   }
 
-  void waitReply(const Key& key) {
+  bool waitReply(const Key& key) {
     int index = get_index(key);
     if (index < 0) throw std::range_error("[waitReply] key " + std::to_string(key) + " not found!");
 
     auto& data = _data[index];
     std::unique_lock<std::mutex> lk(data->mutex);
-    while (!data->flag)
+    while (!data->flag && !stopped())
       data->cond.wait(lk);
-    data->flag.store(false);
+    return data->flag.exchange(false);
   }
 
-  void sendDataWaitReply(const Key& key, Value* value) {
+  bool sendDataWaitReply(const Key& key, Value* value) {
     int index = get_index(key);
     if (index < 0) throw std::range_error("[sendDataWaitReply] key " + std::to_string(key) + " not found!");
 
     auto& data = _data[index];
     data->val = value;
     std::unique_lock<std::mutex> lk(data->mutex);
-#ifdef USE_TBB
+#if defined(USE_TBB) && !defined(USE_EVENT_QUEUE)
     Q.push(index);
 #else
     Q.enqueue(index);
 #endif
-    while (!data->flag)
+    while (!data->flag && !stopped())
       data->cond.wait(lk);
-    data->flag.store(false);
+    return data->flag.exchange(false);
   }
 
   inline Value* waitOne() {
-    int idx;
-#ifdef USE_TBB
+    int idx = 0;
+#if defined(USE_TBB) && !defined(USE_EVENT_QUEUE)
     while (true)
       if (Q.try_pop(idx))
-        return _data[idx]->val;
+        return value_of(idx);
 #else
     Q.wait_dequeue(idx);
-    return _data[idx]->val;
+    return value_of(idx);
 #endif
   }
 
   inline std::pair<Value*, bool> waitOneUntil(int timeout_usec) {
-#ifdef USE_TBB
+#if defined(USE_TBB) && !defined(USE_EVENT_QUEUE)
     int k;
     if (!Q.try_pop(k)) {
       // Sleep would not efficiently return the element.
@@ -142,11 +177,11 @@ class CollectorWithCCQueue {
       if (!Q.try_pop(k))
         return std::make_pair(nullptr, false);
     }
-    return std::make_pair(_data[k]->val, true);
+    return std::make_pair(value_of(k), true);
 #else
-    int k;
+    int k = 0;
     if (Q.wait_dequeue_timed(k, timeout_usec))
-      return std::make_pair(_data[k]->val, true);
+      return std::make_pair(value_of(k), true);
     else
       return std::make_pair(nullptr, false);
 #endif
@@ -154,18 +189,18 @@ class CollectorWithCCQueue {
 
   // signal reply to all data currently waiting
   void signalReplyAll() {
-#ifdef USE_TBB
+#if defined(USE_TBB) && !defined(USE_EVENT_QUEUE)
     std::this_thread::sleep_for(std::chrono::seconds(2));
     int k;
     while (Q.try_pop(k)) {
-      notify(_data[k]);
+      if (k != kStopIndex) notify(_data[k]);
     }
 #else
     // some may lie in queues
     while (true) {
       int k;
       if (Q.wait_dequeue_timed(k, 2)) {
-        notify(_data[k]);
+        if (k != kStopIndex) notify(_data[k]);
       } else {
         break;
       }
@@ -181,9 +216,60 @@ class CollectorWithCCQueue {
 
 };
 
+template <typename Key, typename Value>
+constexpr int CollectorWithCCQueue<Key, Value>::kStopIndex;
+
 template <typename A, typename B>
 using CollectorT = CollectorWithCCQueue<A, B>;
 
+// Picks the batch size and timeouts of a collector from the observed load, so that no item
+// waits more than budget_usec for its batch to fill.
+//   The target batch size doubles while batches fill up and moves towards the achieved size when they do not.
+//   It is capped by how many items arrive within the budget (from the mean inter-arrival time).
+//   Filling never takes longer than one service time of the consumer: past that, sending a
+//   smaller batch now is cheaper than keeping the consumer idle.
+class AdaptiveBatchPolicy {
+  public:
+    explicit AdaptiveBatchPolicy(int budget_usec = 0) : _budget_usec(budget_usec) { }
+
+    bool enabled() const { return _budget_usec > 0; }
+
+    int batchsize(int max_batchsize) const {
+        double target = _target > 0 ? _target : max_batchsize;
+        if (_interval_usec > 0) target = std::min(target, 1 + _budget_usec / _interval_usec);
+        return std::max(1, std::min(max_batchsize, (int)target));
+    }
+
+    // Wait for the next item at most a few mean inter-arrival times.
+    int timeout_usec() const {
+        if (_interval_usec <= 0) return deadline_usec();
+        return std::max(1, std::min(deadline_usec(), (int)(4 * _interval_usec)));
+    }
+
+    int deadline_usec() const {
+        if (_service_usec <= 0) return _budget_usec;
+        return std::max(1, std::min(_budget_usec, (int)_service_usec));
+    }
+
+    // n items filled in fill_usec (first to last item), then served in service_usec.
+    void Update(int n, int max_batchsize, double fill_usec, double service_usec) {
+        int target = batchsize(max_batchsize);
+        if (n >= target) _target = std::min<double>(max_batchsize, 2 * target);
+        else _target = (target + n) / 2.0;
+
+        if (n > 1) _interval_usec = _ewma(_interval_usec, fill_usec / (n - 1));
+        _service_usec = _ewma(_service_usec, service_usec);
+    }
+
+  private:
+    int _budget_usec;
+    double _target = 0;
+    double _interval_usec = 0;
+    double _service_usec = 0;
+
+    static double _ewma(double avg, double v) { return avg <= 0 ? v : 0.9 * avg + 0.1 * v; }
+};
+
 
 template <typename Key, typename Value>
 class BatchCollectorT: public CollectorT<Key, Value> {
@@ -194,21 +280,38 @@ class BatchCollectorT: public CollectorT<Key, Value> {
       CollectorT<Key, Value>{keys} {}
 
     // non reentrable
-    BatchValue waitBatch(int batch_size, int timeout_usec = 0, int timeout_usec_first_item = 0) {
+    // If deadline_usec > 0, the batch is returned at most deadline_usec after its first item.
+    BatchValue waitBatch(int batch_size, int timeout_usec = 0, int timeout_usec_first_item = 0, int deadline_usec = 0) {
+        std::chrono::steady_clock::time_point first_item;
         while ((int)_batch.size() < batch_size) {
             Value *v = nullptr;
-            auto res = (_batch.empty() ? _wait(timeout_usec_first_item) : _wait(timeout_usec));
+            int wait_usec = timeout_usec;
+            if (! _batch.empty() && deadline_usec > 0) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - first_item).count();
+                int left = deadline_usec - (int)elapsed;
+                if (left <= 0) break;
+                wait_usec = (wait_usec == 0 ? left : std::min(wait_usec, left));
+            }
+            auto res = (_batch.empty() ? _wait(timeout_usec_first_item) : _wait(wait_usec));
             if (! res.second) break;
             v = res.first;
+            if (_batch.empty()) first_item = std::chrono::steady_clock::now();
             _batch.emplace_back(v);
+            // A stop entry (see sendStop) ends the batch at once.
+            if (v == nullptr) break;
         }
+        _fill_usec = _batch.empty() ? 0 : std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - first_item).count();
         BatchValue ret;
         ret.swap(_batch);
         return ret;
     }
 
+    // Time from the first item of the last batch until it was returned.
+    double last_fill_usec() const { return _fill_usec; }
+
   private:
     std::vector<Value*> _batch;
+    double _fill_usec = 0;
 
     std::pair<Value *, bool> _wait(int timeout_usec) {
         return (timeout_usec == 0 ? std::make_pair(this->waitOne(), true) : this->waitOneUntil(timeout_usec));
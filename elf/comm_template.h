@@ -100,6 +100,7 @@ public:
     using Infos = InfosT<Data>;
     using SyncSignal = SyncSignalT<Data>;
     using CollectorGroup = CollectorGroupT<In>;
+    using ReplyFunc = std::function<void (const Key &key)>;
 
 private:
     struct Stat {
@@ -129,14 +130,27 @@ private:
     std::vector<Key> _keys;
     std::vector<std::vector<GroupStat>> _exclusive_groups;
 
+    // Cancelled by Stop. Declared before everything waiting on it, so that it outlives them.
+    CancelToken _cancel;
+
     std::vector<std::unique_ptr<CollectorGroup> > _groups;
     ctpl::thread_pool _pool;
 
     std::unique_ptr<SyncSignal> _signal;
     CommStats _stats;
 
-    // Key -> Stat.
-    std::unordered_map<Key, Stat> _map;
+    elf::ThreadAffinity _affinity;
+
+    // Key -> Stat, indexed by _key_index.
+    std::unique_ptr<elf::KeyIndex<Key>> _key_index;
+    std::vector<Stat> _key_stats;
+
+    // If set, called once all groups a key was sent to have replied (see SetReplyFunc).
+    ReplyFunc _reply_func;
+    // Per key, the replies still missing.
+    std::vector<std::atomic<int>> _pending;
+    // Added while a key is being sent, so that replies during the send do not report it early.
+    static constexpr int kPendingBias = 1 << 20;
 
     bool _verbose;
 
@@ -145,8 +159,12 @@ private:
         for (int i = 0 ; i < _context_options.num_games; ++i) _keys.push_back(get_query_id(i, -1));
         // If multithread, register relevant keys.
         if (_context_options.max_num_threads) {
+            // Batched leaf evaluation in tree search uses several comms per search thread.
+            const auto &mcts = _context_options.mcts_options;
+            int num_threads = _context_options.max_num_threads;
+            if (mcts.leaf_batch_size > 1) num_threads = std::max(num_threads, mcts.num_threads * mcts.leaf_batch_size);
             for (int i = 0 ; i < _context_options.num_games; ++i) {
-                for (int tid = 0; tid < _context_options.max_num_threads; ++tid) {
+                for (int tid = 0; tid < num_threads; ++tid) {
                     _keys.push_back(get_query_id(i, tid));
                 }
             }
@@ -154,14 +172,28 @@ private:
     }
 
     void init_stats() {
+        _key_index.reset(new elf::KeyIndex<Key>(_keys));
         for (const Key& key : _keys) {
-            _map.emplace(std::make_pair(key, Stat(key)));
+            _key_stats.emplace_back(key);
+            _key_stats.back().counter->SetCancel(&_cancel);
         }
+        _pending = std::vector<std::atomic<int>>(_keys.size());
+    }
+
+    void on_reply(const Key &key) {
+        int index = _key_index->Find(key);
+        if (index >= 0 && -- _pending[index] == 0) _reply_func(key);
+    }
+
+    Stat *find_stat(const Key &key) {
+        int index = _key_index->Find(key);
+        return index >= 0 ? &_key_stats[index] : nullptr;
     }
 
 public:
     CommT(const ContextOptions &context_options)
-      : _context_options(context_options),  _g(_rd()), _verbose(context_options.verbose_comm) {
+      : _context_options(context_options),  _g(_rd()), _affinity(context_options.thread_affinity, context_options.max_num_threads),
+        _verbose(context_options.verbose_comm) {
         _signal.reset(new SyncSignal());
         compute_keys();
         init_stats();
@@ -169,8 +201,11 @@ public:
 
     int AddCollectors(int batchsize, int exclusive_id, int timeout_usec, const GroupStat &gstat) {
         _groups.emplace_back(new CollectorGroup(_groups.size(), _keys, batchsize, _signal.get(),
-                    _context_options.verbose_collector, timeout_usec));
+                    _context_options.verbose_collector, timeout_usec,
+                    _context_options.batch_slots, _context_options.batch_wait_budget_usec, _context_options.num_buffers));
         int gid = _groups.size() - 1;
+        _groups.back()->SetNumaNode(_affinity.CollectorNode(gid));
+        _groups.back()->SetCancel(&_cancel);
 
         if ((int)_exclusive_groups.size() <= exclusive_id) {
             _exclusive_groups.emplace_back();
@@ -193,37 +228,61 @@ public:
     }
 
     CollectorGroup &GetCollectorGroup(int gid) { return *_groups[gid]; }
+    const elf::ThreadAffinity &affinity() const { return _affinity; }
     int num_groups() const { return _groups.size(); }
 
+    // Report keys whose replies are all in, so that games need not block in WaitReply.
+    // Has to be called before CollectorsReady.
+    void SetReplyFunc(ReplyFunc reply_func) { _reply_func = reply_func; }
+
     void CollectorsReady() {
         if (_context_options.wait_per_group) {
             _signal->use_queue_per_group(_groups.size());
         }
 
-        for (auto &p : _map) {
-            p.second.InitCond(_exclusive_groups.size());
+        if (_reply_func) {
+            for (auto &g : _groups) {
+                g->SetReplyHook([this](const Key &key) { on_reply(key); });
+            }
+        }
+
+        for (auto &stats : _key_stats) {
+            stats.InitCond(_exclusive_groups.size());
         }
 
         _pool.resize(_groups.size());
         for (auto &g : _groups) {
           CollectorGroup *p = g.get();
-          _pool.push([p, this](int) { p->MainLoop(); });
+          _pool.push([p, this](int) {
+              _affinity.PinCollector(p->gid());
+              p->MainLoop();
+          });
         }
     }
 
     // Agent side.
     bool SendDataWaitReply(const Key& key, In& info) {
-        auto it = _map.find(key);
-        if (it == _map.end()) {
+        std::vector<int> selected_groups;
+        if (! SendData(key, info, &selected_groups)) return false;
+        return WaitReply(key, selected_groups);
+    }
+
+    // Send without waiting, so that one agent can have several keys in flight.
+    // Each SendData has to be followed by WaitReply with the returned groups.
+    bool SendData(const Key& key, In& info, std::vector<int> *selected_groups) {
+        int index = _key_index->Find(key);
+        if (index < 0) {
             V_PRINT(_verbose, "[k=" << key << "] seq = " << info.data.newest().seq << " hist_len = " << info.data.size() << ", key[" << key << "] invalid! ");
             return false;
         }
-        Stat &stats = it->second;
+        Stat &stats = _key_stats[index];
+        if (_reply_func) _pending[index] += kPendingBias;
         stats.freq ++;
 
         V_PRINT(_verbose, "[k=" << key << "] Start sending data, seq = " << info.data.newest().seq << " hist_len = " << info.data.size());
         // Send the key to all collectors in the container, if the key satisfy the gating function.
-        std::vector<int> selected_groups;
+        selected_groups->clear();
+        info.sent_at = std::chrono::steady_clock::now();
         std::string str_selected_groups;
 
         // For each exclusive group, randomly select one.
@@ -237,23 +296,35 @@ public:
 
                 _groups[gstat.gid]->SendData(key, &info);
                 str_selected_groups += std::to_string(gstat.gid) + ",";
-                selected_groups.push_back(gstat.gid);
+                selected_groups->push_back(gstat.gid);
             }
         }
 
-        if (! selected_groups.empty()) {
-            V_PRINT(_verbose, "[k=" << key << "] Sent to " << selected_groups.size() << " groups " << str_selected_groups << " waiting for the data to be processed");
+        V_PRINT(_verbose, "[k=" << key << "] Sent to " << selected_groups->size() << " groups " << str_selected_groups);
+        if (_reply_func && (_pending[index] -= kPendingBias - (int)selected_groups->size()) == 0) _reply_func(key);
+        return true;
+    }
 
-            // Wait until all collectors have done their jobs.
-            stats.counter->wait(selected_groups.size());
-            stats.counter->reset();
+    // False if the comm is stopped before all replies came.
+    bool WaitReply(const Key& key, const std::vector<int> &selected_groups) {
+        if (selected_groups.empty()) return true;
 
-            V_PRINT(_verbose, "[k=" << key << "] All " << selected_groups.size() << " has done their jobs, Wait until the game is released");
+        Stat *p = find_stat(key);
+        if (p == nullptr) return true;
+        Stat &stats = *p;
 
-            // Finally wait until resume is sent.
-            for (const int gid : selected_groups) {
-                _groups[gid]->WaitReply(key);
-            }
+        V_PRINT(_verbose, "[k=" << key << "] Waiting for " << selected_groups.size() << " groups to process the data");
+
+        // Wait until all collectors have done their jobs.
+        stats.counter->wait(selected_groups.size());
+        stats.counter->reset();
+        if (stats.counter->stopped()) return false;
+
+        V_PRINT(_verbose, "[k=" << key << "] All " << selected_groups.size() << " has done their jobs, Wait until the game is released");
+
+        // Finally wait until resume is sent.
+        for (const int gid : selected_groups) {
+            if (! _groups[gid]->WaitReply(key)) return false;
         }
 
         V_PRINT(_verbose, "[k=" << key << "] Done with SendDataWaitReply");
@@ -269,14 +340,12 @@ public:
         // For invalid infos, return.
         if (infos.gid < 0) return false;
 
-        std::vector<Key> keys = _groups[infos.gid]->GetBatchKeys();
+        std::vector<Key> keys = _groups[infos.gid]->GetBatchKeys(infos.buf_id);
         for (const Key &key : keys) {
-            auto it = _map.find(key);
-            if (it != _map.end()) {
-                it->second.counter->notify();
-            }
+            Stat *p = find_stat(key);
+            if (p != nullptr) p->counter->notify();
         }
-        _groups[infos.gid]->SignalBatchUsed(future_time_usec);
+        _groups[infos.gid]->SignalBatchUsed(future_time_usec, infos.buf_id);
         return true;
     }
 
@@ -284,10 +353,21 @@ public:
         for (const auto &g : _groups) g->PrintSummary();
     }
 
-    void PrepareStop() {
-        for (const auto &g : _groups) g->SetBatchSize(1);
+    // Latency and batch size histograms, indexed by group id.
+    std::vector<std::map<std::string, std::map<std::string, double>>> GetStats() const {
+        std::vector<std::map<std::string, std::map<std::string, double>>> stats;
+        for (const auto &g : _groups) stats.push_back(g->GetStats());
+        return stats;
     }
 
+    // Make every wait of games and collectors return with a stopped status. Collectors let go of
+    // the games first, so that a game can exit as soon as its wait returns.
+    void Cancel() {
+        for (auto &g : _groups) g->ReleaseGames();
+        _cancel.Cancel();
+    }
+    CancelToken &cancel_token() { return _cancel; }
+
     void Stop() {
         // Block all sends from game environments.
         Notif &done = _signal->GetDoneNotif();
@@ -302,6 +382,28 @@ public:
     }
 };
 
+// A game for ContextT::StartCooperative. Instead of owning a thread and blocking in
+// SendDataWaitReply, it advances in Step() calls made by a few worker threads shared by all games.
+template <typename _AIComm>
+class CoopGameT {
+public:
+    using AIComm = _AIComm;
+
+    enum Status {
+        // The last thing Step() did was ai_comm->SendData(). Step() is called again (maybe on
+        // another worker) when the reply is in ai_comm->info().data, but never before this Step()
+        // returned. Between SendData() and returning, Step() must not touch the sent state.
+        SENT,
+        // Call Step() again later.
+        YIELD,
+        // The game is over. Games should end once signal.IsDone().
+        DONE
+    };
+
+    virtual Status Step(const elf::Signal &signal) = 0;
+    virtual ~CoopGameT() { }
+};
+
 // The game context, which could include multiple games.
 template <typename _Options, typename _Data>
 class ContextT {
@@ -320,6 +422,10 @@ public:
 
     using GameStartFunc = std::function<void (int game_idx, const ContextOptions &context_options, const Options& options, const elf::Signal &signal, Comm *comm)>;
 
+    using CoopGame = CoopGameT<AIComm>;
+    // The returned game is owned by the context.
+    using CoopGameFunc = std::function<CoopGame *(int game_idx, const ContextOptions &context_options, const Options& options, AIComm *ai_comm)>;
+
 private:
     Comm _comm;
     Options _options;
@@ -330,10 +436,62 @@ private:
     std::atomic_bool _prepare_stop;
     bool _game_started = false;
 
+    // Cooperative mode.
+    struct CoopTask {
+        std::unique_ptr<AIComm> ai_comm;
+        std::unique_ptr<CoopGame> game;
+    };
+    std::vector<CoopTask> _coop_tasks;
+    std::unique_ptr<elf::KeyIndex<Key>> _coop_index;
+    // Games to step. -1 stops a worker.
+    CCQueue2<int> _coop_ready;
+    // Per game: 1 while it is stepped, +1 when its reply comes. Whoever brings it back to 0 queues it.
+    std::vector<std::atomic<int>> _coop_holds;
+    std::atomic<int> _coop_running;
+
+    void init_base_seed() {
+        // Games seed from context_options().game_seed(game_idx), so they can all start at once.
+        // Resolved here, since games may be constructed (and seeded) before Start.
+        if (_context_options.base_seed == 0) {
+            _context_options.base_seed = elf::RandomBaseSeed();
+            std::cout << "Base seed: " << _context_options.base_seed << std::endl;
+        }
+    }
+
+    void coop_worker() {
+        elf::Signal signal(_done.flag(), _prepare_stop);
+        while (true) {
+            int i;
+            _coop_ready.wait_dequeue(i);
+            if (i < 0) break;
+
+            CoopTask &task = _coop_tasks[i];
+            // Returns at once: a game is only queued after all its replies are in.
+            task.ai_comm->WaitReply();
+            _coop_holds[i] = 1;
+            switch (task.game->Step(signal)) {
+                case CoopGame::SENT:
+                    // Queued again by the reply, or here if it came while Step() was running.
+                    if (-- _coop_holds[i] != 0) _coop_ready.enqueue(i);
+                    break;
+                case CoopGame::YIELD:
+                    _coop_ready.enqueue(i);
+                    break;
+                case CoopGame::DONE:
+                    if (-- _coop_running == 0) {
+                        for (int k = 0; k < _pool.size(); ++k) _coop_ready.enqueue(-1);
+                    }
+                    break;
+            }
+        }
+    }
+
 public:
     ContextT(const ContextOptions &context_options, const Options& options)
         : _comm(context_options), _options(options), _context_options(context_options),
-          _pool(context_options.num_games) {
+          _pool(context_options.num_game_threads > 0 ? context_options.num_game_threads : context_options.num_games),
+          _coop_running(0) {
+        init_base_seed();
     }
 
     Comm &comm() { return _comm; }
@@ -343,19 +501,63 @@ public:
     const Options &options() const { return _options; }
 
     void Start(GameStartFunc game_start_func) {
+        if (_context_options.num_game_threads > 0) {
+            throw std::range_error("Start: num_game_threads = " + std::to_string(_context_options.num_game_threads) + ", use StartCooperative");
+        }
         _comm.CollectorsReady();
 
         // Now we start all jobs.
         for (int i = 0; i < _pool.size(); ++i) {
-            _pool.push([i, this, &game_start_func](int){
+            _pool.push([i, this, game_start_func](int){
+                _comm.affinity().PinGame(i);
                 elf::Signal signal(_done.flag(), _prepare_stop);
                 game_start_func(i, _context_options, _options, signal, &_comm);
                 // std::cout << "G[" << i << "] is ending" << std::endl;
                 _done.notify();
             });
+        }
+        _game_started = true;
+    }
 
-            // TODO sleep to avoid random seed problem?
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    // Run all games on ContextOptions.num_game_threads worker threads. A game waiting for its
+    // reply holds no thread, so the number of games is not limited by threads.
+    void StartCooperative(CoopGameFunc create_game) {
+        if (_context_options.num_game_threads <= 0) {
+            throw std::range_error("StartCooperative needs num_game_threads > 0");
+        }
+
+        std::vector<Key> keys;
+        for (int i = 0; i < _context_options.num_games; ++i) {
+            CoopTask task;
+            task.ai_comm.reset(new AIComm(i, &_comm));
+            task.game.reset(create_game(i, _context_options, _options, task.ai_comm.get()));
+            keys.push_back(task.ai_comm->info().meta.query_id);
+            _coop_tasks.push_back(std::move(task));
+        }
+        _coop_index.reset(new elf::KeyIndex<Key>(keys));
+        _coop_holds = std::vector<std::atomic<int>>(keys.size());
+
+        // Replies of other keys (e.g. spawned AIComms) are waited for the usual way.
+        _comm.SetReplyFunc([this](const Key &key) {
+            int i = _coop_index->Find(key);
+            if (i >= 0 && ++ _coop_holds[i] == 1) _coop_ready.enqueue(i);
+        });
+        _comm.cancel_token().OnCancel([this]() {
+            for (int k = 0; k < _pool.size(); ++k) _coop_ready.enqueue(-1);
+        });
+        _comm.CollectorsReady();
+
+        _coop_running = _coop_tasks.size();
+        for (int i = 0; i < (int)_coop_tasks.size(); ++i) _coop_ready.enqueue(i);
+        if (_coop_tasks.empty()) {
+            for (int k = 0; k < _pool.size(); ++k) _coop_ready.enqueue(-1);
+        }
+        for (int i = 0; i < _pool.size(); ++i) {
+            _pool.push([this, i](int) {
+                _comm.affinity().PinGame(i);
+                coop_worker();
+                _done.notify();
+            });
         }
         _game_started = true;
     }
@@ -364,9 +566,10 @@ public:
     Infos WaitGroup(int group_id, int timeout_usec) { return _comm.WaitGroupBatchData(group_id, timeout_usec); }
     void Steps(const Infos& infos) { _comm.Steps(infos); }
 
-    int size() const { return _pool.size(); }
+    int size() const { return _context_options.num_games; }
 
     void PrintSummary() const { _comm.PrintSummary(); }
+    std::vector<std::map<std::string, std::map<std::string, double>>> GetStats() const { return _comm.GetStats(); }
 
     std::string Version() const {
 #ifdef GIT_COMMIT_HASH
@@ -380,38 +583,24 @@ public:
 #undef TOSTRING
     }
 
+    // Bounded in time: games and collectors blocked on a reply are woken up by the cancel token
+    // instead of being drained by more batches.
     void Stop() {
         // Call the destructor.
         if (! _game_started) return;
 
-        ctpl::thread_pool tmp_pool(1);
-        const int wait_usec = 2;
-        std::atomic_bool tmp_thread_done(false);
-        tmp_pool.push([&](int) {
-            while (! tmp_thread_done) {
-                Steps(Wait(wait_usec));
-            }
-        });
-
         _prepare_stop = true;
 
-        // First set all batchsize to be 1.
-        std::cout << "Prepare to stop ..." << std::endl;
-        _comm.PrepareStop();
-
-        // Then stop all game threads.
+        // Stop all game threads.
         std::cout << "Stop all game threads ..." << std::endl;
         _done.set();
+        _comm.Cancel();
         _done.wait(_pool.size());
         _pool.stop();
 
         // Finally stop all collectors.
         std::cout << "Stop all collectors ..." << std::endl;
         _comm.Stop();
-
-        std::cout << "Stop tmp pool..." << std::endl;
-        tmp_thread_done = true;
-        tmp_pool.stop();
         _game_started = false;
     }
 
@@ -21,6 +21,12 @@ class ContextArgs:
                 ("eval", dict(action="store_true")),
                 ("wait_per_group", dict(action="store_true")),
                 ("num_collectors", 0),
+                ("batch_slots", dict(action="store_true")),
+                ("batch_wait_budget_usec", 0),
+                ("num_buffers", 1),
+                ("thread_affinity", dict(type=str, default="", help="Pin game and collector threads: compact, scatter, numa or a cpu list like 0-7,16-23. Each game gets mcts_threads cpus")),
+                ("base_seed", dict(type=int, default=0, help="Base seed the seeds of all games are derived from, 0 = random")),
+                ("num_game_threads", dict(type=int, default=0, help="Run all games on this many threads (games that support it), 0 = one thread per game")),
                 ("verbose_comm", dict(action="store_true")),
                 ("verbose_collector", dict(action="store_true")),
                 ("mcts_threads", 0),
@@ -56,6 +62,12 @@ class ContextArgs:
 
         co.max_num_threads = args.mcts_threads
         co.num_collectors = args.num_collectors
+        co.batch_slots = args.batch_slots
+        co.batch_wait_budget_usec = args.batch_wait_budget_usec
+        co.num_buffers = args.num_buffers
+        co.thread_affinity = args.thread_affinity
+        co.base_seed = args.base_seed
+        co.num_game_threads = args.num_game_threads
 
         mcts = co.mcts_options
 
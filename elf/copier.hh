@@ -9,6 +9,7 @@
 #include "lib/debugutils.hh"
 #include "pybind_helper.h"
 #include "shared_buffer.hh"
+#include "float16.h"
 
 #define MM_DECLTYPE(_, x) decltype(x)
 #define MM_STRINGIFY(_, x) #x
@@ -50,6 +51,9 @@ TYPESTR(float);
 TYPESTR(unsigned char);
 TYPESTR(short);
 TYPESTR(bool);
+// Compact types for feature planes. uint8_t is unsigned char.
+TYPESTR(int8_t);
+template <> class TypeStr<elf::float16> { public: static constexpr char const *str = "float16"; };
 
 template <typename Struct, typename FieldT, typename Enable=void>
 class FieldMemoryManagerT;
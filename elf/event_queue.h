@@ -0,0 +1,154 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef USE_TBB
+#include <tbb/concurrent_queue.h>
+#else
+#include "concurrentqueue.h"
+#endif
+
+// Lets consumers sleep until something is pushed, without a lock on the push path.
+// A consumer calls prepare_wait(), checks its condition once more, then either
+// cancel_wait() or wait(key). A notify() between prepare_wait() and wait() is never lost.
+class EventCount {
+public:
+    uint32_t prepare_wait() {
+        _waiters.fetch_add(1);
+        return _seq.load();
+    }
+
+    void cancel_wait() { _waiters.fetch_sub(1); }
+
+    // Sleep until notify() or timeout (usec < 0 waits forever). Ends the wait started with prepare_wait().
+    void wait(uint32_t key, int64_t usec = -1) {
+#ifdef __linux__
+        if (usec < 0) {
+            syscall(SYS_futex, &_seq, FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+        } else {
+            struct timespec ts;
+            ts.tv_sec = usec / 1000000;
+            ts.tv_nsec = (usec % 1000000) * 1000;
+            syscall(SYS_futex, &_seq, FUTEX_WAIT_PRIVATE, key, &ts, nullptr, 0);
+        }
+#else
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto changed = [this, key]() { return _seq.load() != key; };
+        if (usec < 0) _cv.wait(lock, changed);
+        else _cv.wait_for(lock, std::chrono::microseconds(usec), changed);
+#endif
+        _waiters.fetch_sub(1);
+    }
+
+    void notify(bool all = false) {
+        _seq.fetch_add(1);
+        if (_waiters.load() == 0) return;
+#ifdef __linux__
+        syscall(SYS_futex, &_seq, FUTEX_WAKE_PRIVATE, all ? INT32_MAX : 1, nullptr, nullptr, 0);
+#else
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (all) _cv.notify_all();
+        else _cv.notify_one();
+#endif
+    }
+
+private:
+    // futex works on a 32-bit word.
+    std::atomic<uint32_t> _seq{0};
+    std::atomic<int> _waiters{0};
+#ifndef __linux__
+    std::mutex _mutex;
+    std::condition_variable _cv;
+#endif
+};
+
+// Lock-free queue whose consumers spin for a short while, then park in the kernel.
+// Same interface as moodycamel::BlockingConcurrentQueue, so it can replace it.
+template <typename T>
+class EventQueue {
+public:
+    explicit EventQueue(int spin_count = 1000) : _spin_count(spin_count) { }
+
+    EventQueue(const EventQueue &) = delete;
+
+    bool enqueue(const T &val) {
+        _push(val);
+        _event.notify();
+        return true;
+    }
+
+    bool try_dequeue(T &val) { return _try_pop(val); }
+
+    void wait_dequeue(T &val) {
+        while (! _spin_pop(val)) {
+            uint32_t key = _event.prepare_wait();
+            if (_try_pop(val)) {
+                _event.cancel_wait();
+                return;
+            }
+            _event.wait(key);
+        }
+    }
+
+    bool wait_dequeue_timed(T &val, int64_t timeout_usec) {
+        if (_spin_pop(val)) return true;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_usec);
+        while (true) {
+            uint32_t key = _event.prepare_wait();
+            if (_try_pop(val)) {
+                _event.cancel_wait();
+                return true;
+            }
+            auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) {
+                _event.cancel_wait();
+                return false;
+            }
+            _event.wait(key, left);
+            if (_try_pop(val)) return true;
+        }
+    }
+
+private:
+#ifdef USE_TBB
+    tbb::concurrent_queue<T> _q;
+    void _push(const T &val) { _q.push(val); }
+    bool _try_pop(T &val) { return _q.try_pop(val); }
+#else
+    moodycamel::ConcurrentQueue<T> _q;
+    void _push(const T &val) { _q.enqueue(val); }
+    bool _try_pop(T &val) { return _q.try_dequeue(val); }
+#endif
+
+    EventCount _event;
+    int _spin_count;
+
+    bool _spin_pop(T &val) {
+        for (int i = 0; i < _spin_count; ++i) {
+            if (_try_pop(val)) return true;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        return false;
+    }
+};
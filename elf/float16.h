@@ -0,0 +1,21 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+namespace elf {
+
+// IEEE half precision float stored as uint16_t. Only a storage type: a field declared as float16
+// (or vector<float16>) is copied as is and shows up as a float16 tensor. The game fills in the bits.
+struct float16 {
+    uint16_t bits;
+};
+
+}  // namespace elf
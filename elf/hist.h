@@ -15,6 +15,7 @@
 #include "circular_queue.h"
 #include "copier.hh"
 #include "common.h"
+#include "member_check.h"
 
 template <typename _Data>
 class HistT {
@@ -99,6 +100,61 @@ void CopyToMem(const std::vector<CopyItemT<State>> &copier, const std::vector<Hi
   }
 }
 
+MEMBER_FUNC_CHECK(WriteToSlot)
+
+// A State may write a field of its newest entry straight into the slot instead of having it
+// copied, with bool WriteToSlot(const std::string &key, void *dst) const. False falls back to the copy.
+template <typename State, typename std::enable_if<has_func_WriteToSlot<State>::value>::type *U = nullptr>
+bool WriteToSlot(const State &s, const std::string &key, void *dst) {
+  return s.WriteToSlot(key, dst);
+}
+
+template <typename State, typename std::enable_if<! has_func_WriteToSlot<State>::value>::type *U = nullptr>
+bool WriteToSlot(const State &, const std::string &, void *) {
+  return false;
+}
+
+// Batch slot mode: each buffer is laid out as [T][batch_stride][...] and a game owns one slot of it,
+// so games can copy their own history concurrently and the collector copies nothing.
+template <typename State>
+void CopyToSlot(const std::vector<CopyItemT<State>> &copier, const HistT<State> &h, int slot, int batch_stride) {
+  size_t overall_hist_len = h.size();
+
+  for (const auto& item: copier) {
+    const State &newest = h.newest();
+    size_t sz = item.mm->size(newest);
+    size_t hist_len = item.Capacity(newest) / batch_stride;
+    size_t min_hist_len = std::min(hist_len, overall_hist_len);
+
+    for (size_t t = 0; t < hist_len; ++t) {
+      // Same as CopyToMem, missing history is filled with the oldest one.
+      const State &state = h.newest(t < min_hist_len ? min_hist_len - t - 1 : min_hist_len - 1);
+      char *dst = item.ptr() + (t * batch_stride + slot) * sz;
+      if (&state == &newest && WriteToSlot(state, item.key, dst)) continue;
+      item.CopyToMem(state, dst);
+    }
+  }
+}
+
+template <typename State>
+void CopyFromSlots(const std::vector<CopyItemT<State>> &copier, std::vector<HistT<State> *> &batch, int batch_stride) {
+  if (batch.empty()) return;
+  size_t overall_hist_len = batch[0]->size();
+
+  for (const auto& item: copier) {
+    size_t sz = item.mm->size(batch[0]->newest());
+    size_t hist_len = item.Capacity(batch[0]->newest()) / batch_stride;
+    size_t min_hist_len = std::min(hist_len, overall_hist_len);
+
+    for (size_t t = 0; t < min_hist_len; ++t) {
+      for (size_t i = 0; i < batch.size(); ++i) {
+        State &state = batch[i]->newest(min_hist_len - t - 1);
+        item.CopyFromMem(state, item.ptr() + (t * batch_stride + i) * sz);
+      }
+    }
+  }
+}
+
 template <typename State>
 void CopyFromMem(const std::vector<CopyItemT<State>> &copier, std::vector<HistT<State> *> &batch) {
   if (batch.empty()) return;
@@ -0,0 +1,80 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <stdint.h>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace elf {
+
+// Maps a fixed set of keys, registered once at construction, to 0 .. size() - 1.
+// Keys are query ids (see get_query_id): the game id in the low 24 bits and thread id + 1 above.
+// Both are small and dense, so a lookup is a read from a table of #threads x #games slots.
+// Keys too sparse for such a table fall back to a hash map.
+// Read-only after construction, so lookups from any thread need no lock.
+template <typename Key>
+class KeyIndex {
+public:
+    static_assert(std::is_integral<Key>::value, "KeyIndex needs integral keys");
+
+    explicit KeyIndex(const std::vector<Key> &keys) : _size(keys.size()) {
+        uint64_t num_hi = 0, num_lo = 0;
+        bool dense = true;
+        for (const Key &key : keys) {
+            if (key < 0) {
+                dense = false;
+                break;
+            }
+            num_hi = std::max<uint64_t>(num_hi, ((uint64_t)key >> kLowBits) + 1);
+            num_lo = std::max<uint64_t>(num_lo, ((uint64_t)key & kLowMask) + 1);
+        }
+        // Allow some holes, but not a table much larger than the keys.
+        if (dense && num_hi * num_lo <= 4 * keys.size() + 1024) {
+            _num_hi = num_hi;
+            _num_lo = num_lo;
+            _table.assign(num_hi * num_lo, -1);
+            for (size_t i = 0; i < keys.size(); ++i) {
+                _table[((uint64_t)keys[i] >> kLowBits) * _num_lo + ((uint64_t)keys[i] & kLowMask)] = i;
+            }
+        } else {
+            for (size_t i = 0; i < keys.size(); ++i) _map.emplace(keys[i], i);
+        }
+    }
+
+    // Index of key, -1 if it was not registered.
+    int Find(const Key &key) const {
+        if (! _table.empty()) {
+            if (key < 0) return -1;
+            uint64_t hi = (uint64_t)key >> kLowBits, lo = (uint64_t)key & kLowMask;
+            if (hi >= _num_hi || lo >= _num_lo) return -1;
+            return _table[hi * _num_lo + lo];
+        }
+        auto it = _map.find(key);
+        return it == _map.end() ? -1 : it->second;
+    }
+
+    int size() const { return _size; }
+    bool dense() const { return ! _table.empty(); }
+
+private:
+    static constexpr int kLowBits = 24;
+    static constexpr uint64_t kLowMask = (1ULL << kLowBits) - 1;
+
+    int _size;
+
+    uint64_t _num_hi = 0, _num_lo = 0;
+    std::vector<int> _table;
+
+    std::unordered_map<Key, int> _map;
+};
+
+}  // namespace elf
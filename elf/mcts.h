@@ -12,6 +12,7 @@
 #include <iostream>
 #include <atomic>
 #include <type_traits>
+#include <algorithm>
 #include "utils.h"
 #include "tree_search.h"
 #include "member_check.h"
@@ -50,6 +51,7 @@ public:
             clock.Restart();
 
             auto res = ts_->Run(s);
+            if (! res.found()) return false;
             *a = res.best_a;
 
             clock.Record("MCTS");
@@ -57,6 +59,7 @@ public:
             cout << clock.Summary() << endl;
         } else {
             auto res = ts_->Run(s);
+            if (! res.found()) return false;
             *a = res.best_a;
         }
         return true;
@@ -124,10 +127,10 @@ public:
         : ai_comm_(ai_comm) {
         static_assert(std::is_same<ActorParam, void>::value, "The constructor requires ActorParam to be void (or omitted)");
         // Construct a few DirectPredictAIs.
-        spawn_aicomms(options.num_threads);
+        spawn_aicomms(options);
 
         // cout << "#ai = " << ai_dup.size() << endl;
-        auto actor_gen = [&](int i) { return new Actor(ai_comms_[i].get()); };
+        auto actor_gen = [&](int i) { return add_batch_aicomms(new Actor(ai_comms_[i].get()), i, options); };
         // cout << "Done with MCTSAI_T::InitAIComm" << endl;
         mcts_ai_.reset(new MCTSAI(options, actor_gen));
     }
@@ -136,10 +139,10 @@ public:
         : ai_comm_(ai_comm) {
         static_assert(! std::is_same<ActorParam, void>::value, "The constructor requires ActorParam to be set (not void)");
         // Construct a few DirectPredictAIs.
-        spawn_aicomms(options.num_threads);
+        spawn_aicomms(options);
 
         // cout << "#ai = " << ai_dup.size() << endl;
-        auto actor_gen = [&](int i) { return new Actor(ai_comms_[i].get(), *params); };
+        auto actor_gen = [&](int i) { return add_batch_aicomms(new Actor(ai_comms_[i].get(), *params), i, options); };
         // cout << "Done with MCTSAI_T::InitAIComm" << endl;
         mcts_ai_.reset(new MCTSAI(options, actor_gen));
     }
@@ -169,14 +172,34 @@ private:
     vector<unique_ptr<AIComm>> ai_comms_;
     unique_ptr<MCTSAI> mcts_ai_;
 
-    void spawn_aicomms(int num_threads) {
+    MEMBER_FUNC_CHECK(AddBatchAIComm)
+
+    void spawn_aicomms(const mcts::TSOptions &options) {
         // Construct a few DirectPredictAIs.
+        // With batched leaf evaluation, thread i also owns comms [num_threads + i * (B - 1), num_threads + (i + 1) * (B - 1)).
+        int num_comms = options.num_threads;
+        if (has_func_AddBatchAIComm<Actor>::value) num_comms *= std::max(options.leaf_batch_size, 1);
+
         ai_comms_.clear();
-        for (int i = 0; i < num_threads; ++i) {
+        for (int i = 0; i < num_comms; ++i) {
             ai_comms_.emplace_back(ai_comm_->Spawn(i));
         }
     }
 
+    template <typename Actor_ = Actor, typename std::enable_if<has_func_AddBatchAIComm<Actor_>::value>::type *U = nullptr>
+    Actor *add_batch_aicomms(Actor *actor, int i, const mcts::TSOptions &options) {
+        const int extra = std::max(options.leaf_batch_size, 1) - 1;
+        for (int k = 0; k < extra; ++k) {
+            actor->AddBatchAIComm(ai_comms_[options.num_threads + i * extra + k].get());
+        }
+        return actor;
+    }
+
+    template <typename Actor_ = Actor, typename std::enable_if<! has_func_AddBatchAIComm<Actor_>::value>::type *U = nullptr>
+    Actor *add_batch_aicomms(Actor *actor, int, const mcts::TSOptions &) {
+        return actor;
+    }
+
     // cout << "#ai = " << ai_dup.size() << endl;
     std::function<Actor *(int)> actor_gen() {
         return [&](int i) { return new Actor(ai_comms_[i].get()); };
@@ -9,13 +9,17 @@
 #pragma once
 
 #include "blockingconcurrentqueue.h"
+#include "event_queue.h"
+#include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <vector>
 
 template <typename T>
 using CCQueue2 = moodycamel::BlockingConcurrentQueue<T>;
 
-#ifdef USE_TBB
+#if defined(USE_TBB) && !defined(USE_EVENT_QUEUE)
   #include <tbb/concurrent_queue.h>
 
   template <typename T>
@@ -42,8 +46,13 @@ using CCQueue2 = moodycamel::BlockingConcurrentQueue<T>;
     return true;
   }
 #else
+  #ifdef USE_EVENT_QUEUE
+  template <typename T>
+  using CCQueue = EventQueue<T>;
+  #else
   template <typename T>
   using CCQueue = moodycamel::BlockingConcurrentQueue<T>;
+  #endif
 
   template <typename T>
   void push_q(CCQueue<T>& q, const T &val) {
@@ -61,15 +70,56 @@ using CCQueue2 = moodycamel::BlockingConcurrentQueue<T>;
   }
 #endif
 
+// Stops the waits of the primitives attached to it. Cancel() sets the flag and runs the wake-up
+// callbacks the primitives registered, so that every wait returns promptly with a stopped status.
+class CancelToken {
+private:
+    std::atomic_bool _cancelled;
+    std::mutex _mutex;
+    std::vector<std::function<void ()>> _wakeups;
+
+public:
+    CancelToken() : _cancelled(false) { }
+
+    bool cancelled() const { return _cancelled.load(); }
+
+    // f has to take the lock of the waits it wakes up, so that no wakeup is lost.
+    void OnCancel(std::function<void ()> f) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wakeups.push_back(f);
+    }
+
+    void Cancel() {
+        _cancelled = true;
+        std::vector<std::function<void ()>> wakeups;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            wakeups = _wakeups;
+        }
+        for (auto &f : wakeups) f();
+    }
+};
+
 class SemaCollector {
 private:
     int _count;
     std::mutex _mutex;
     std::condition_variable _cv;
+    const CancelToken *_cancel = nullptr;
 
 public:
     SemaCollector() : _count(0) { }
 
+    // Waits return early once token is cancelled, check stopped().
+    void SetCancel(CancelToken *token) {
+        _cancel = token;
+        token->OnCancel([this]() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.notify_all();
+        });
+    }
+    bool stopped() const { return _cancel != nullptr && _cancel->cancelled(); }
+
     inline void notify() {
         std::unique_lock<std::mutex> lock(_mutex);
         _count ++;
@@ -80,11 +130,11 @@ public:
         if (expected_count == 0) return _count;
 
         std::unique_lock<std::mutex> lock(_mutex);
+        auto ready = [this, expected_count]() { return _count >= expected_count || stopped(); };
         if (usec == 0) {
-            _cv.wait(lock, [this, expected_count]() { return _count >= expected_count; });
+            _cv.wait(lock, ready);
         } else {
-            _cv.wait_for(lock, std::chrono::microseconds(usec),
-                [this, expected_count]() { return _count >= expected_count; });
+            _cv.wait_for(lock, std::chrono::microseconds(usec), ready);
         }
         return _count;
     }
@@ -108,14 +158,18 @@ public:
     void notify() { _counter.notify(); }
 
     void set() { _flag = true; }
-    void wait(int n, std::function<void ()> f = nullptr) {
+    void SetCancel(CancelToken *token) { _counter.SetCancel(token); }
+
+    // Return false if stopped by the cancel token before n notifications.
+    bool wait(int n, std::function<void ()> f = nullptr) {
         _flag = true;
-        if (f == nullptr) _counter.wait(n);
+        if (f == nullptr) return _counter.wait(n) >= n;
         else {
             while (true) {
               int current_cnt = _counter.wait(n, 10);
               // std::cout << "current cnt = " << current_cnt << " n = " << n << std::endl;
-              if (current_cnt >= n) break;
+              if (current_cnt >= n) return true;
+              if (_counter.stopped()) return false;
               f();
             }
         }
@@ -133,18 +187,29 @@ private:
     T _val;
     std::mutex _mutex;
     std::condition_variable _cv;
+    const CancelToken *_cancel = nullptr;
 
     inline void _raw_wait(std::unique_lock<std::mutex> &lock, int usec) {
+        auto ready = [this]() { return _flag || (_cancel != nullptr && _cancel->cancelled()); };
         if (usec == 0) {
-            _cv.wait(lock, [this]() { return _flag; });
+            _cv.wait(lock, ready);
         } else {
-            _cv.wait_for(lock, std::chrono::microseconds(usec),  [this]() { return _flag; });
+            _cv.wait_for(lock, std::chrono::microseconds(usec), ready);
         }
     }
 
 public:
     Semaphore() : _flag(false) { }
 
+    // Waits return false once token is cancelled.
+    void SetCancel(CancelToken *token) {
+        _cancel = token;
+        token->OnCancel([this]() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.notify_all();
+        });
+    }
+
     inline void notify(T val) {
         std::unique_lock<std::mutex> lock(_mutex);
         _flag = true;
@@ -12,6 +12,7 @@
 #include "hist.h"
 #include "tree_search_options.h"
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
 
 namespace py = pybind11;
 
@@ -60,6 +61,7 @@ void register_common_func(py::module &m) {
   void Steps(const Infos& infos) { context->Steps(infos); } \
   std::string Version() const { return context->Version(); } \
   void PrintSummary() const { context->PrintSummary(); } \
+  std::vector<std::map<std::string, std::map<std::string, double>>> GetStats() const { return context->GetStats(); } \
   GroupStat CreateGroupStat() const { return GroupStat(); } \
   int AddCollectors(int batchsize, int exclusive_id, int timeout_usec, const GroupStat &gstat) { \
     return context->comm().AddCollectors(batchsize, exclusive_id, timeout_usec, gstat); \
@@ -71,8 +73,8 @@ void register_common_func(py::module &m) {
   EntryInfo GetTensorSpec(int gid, const std::string &key, int T) { \
       return context->comm().GetCollectorGroup(gid).GetEntry(key, T, [&](const std::string &key) { return EntryFunc(key); }); \
   } \
-  void AddTensor(int gid, const std::string &input_reply, const EntryInfo &e) { \
-      context->comm().GetCollectorGroup(gid).AddEntry(input_reply, e); \
+  void AddTensor(int gid, const std::string &input_reply, const EntryInfo &e, int buf_id) { \
+      context->comm().GetCollectorGroup(gid).AddEntry(input_reply, e, buf_id); \
   } \
 
 
@@ -85,12 +87,13 @@ void register_common_func(py::module &m) {
     .def("Steps", &GameContext::Steps, py::call_guard<py::gil_scoped_release>()) \
     .def("Version", &GameContext::Version) \
     .def("PrintSummary", &GameContext::PrintSummary) \
+    .def("GetStats", &GameContext::GetStats) \
     .def("CreateGroupStat", &GameContext::CreateGroupStat, py::return_value_policy::copy) \
     .def("AddCollectors", &GameContext::AddCollectors) \
     .def("Start", &GameContext::Start) \
     .def("Stop", &GameContext::Stop) \
     .def("__len__", &GameContext::size) \
-    .def("AddTensor", &GameContext::AddTensor) \
+    .def("AddTensor", &GameContext::AddTensor, py::arg("gid"), py::arg("input_reply"), py::arg("e"), py::arg("buf_id") = 0) \
     .def("GetTensorSpec", &GameContext::GetTensorSpec, py::return_value_policy::copy) \
     .def("GetCollectorInfos", &GameContext::GetCollectorInfos) \
 
@@ -15,6 +15,7 @@
 #include <string>
 
 #include "pybind_helper.h"
+#include "seed_seq.h"
 #include "tree_search_options.h"
 
 struct ContextOptions {
@@ -36,22 +37,55 @@ struct ContextOptions {
 
     int num_collectors = 1;
 
+    // Games write their input straight into their slot of the batch, instead of the collector copying it.
+    bool batch_slots = false;
+
+    // If > 0, collectors adapt their batch size and timeouts to the load, so that no game waits
+    // longer than this for its batch to fill. The batchsize of a collector is then its maximum.
+    int batch_wait_budget_usec = 0;
+
+    // If > 0, games run cooperatively on this many threads (see ContextT::StartCooperative)
+    // instead of one thread per game. Only for games written as a CoopGameT, which none of the
+    // shipped games are yet, so it is not in ContextArgs.
+    int num_game_threads = 0;
+
+    // Pin game and collector threads: "compact", "scatter", "numa" or a CPU list like "0-7,16-23".
+    // Empty for no pinning. A game gets max_num_threads CPUs (at least one), which its search threads
+    // inherit. See elf::ThreadAffinity.
+    std::string thread_affinity;
+
+    // Number of shared buffer sets per collector. With more than one, the next batch is
+    // assembled while the previous one is still being consumed.
+    int num_buffers = 1;
+
+    // Base seed of all games. Each game derives its own seeds from it with game_seed().
+    // If 0, a random base seed is picked when the context is created (and printed, so the run can be reproduced).
+    uint64_t base_seed = 0;
+
     mcts::TSOptions mcts_options;
 
     ContextOptions() {}
 
+    int game_seed(int game_idx, int stream = 0) const { return elf::GameSeed(base_seed, game_idx, stream); }
+
     void print() const {
       std::cout << "#Game: " << num_games << std::endl;
       std::cout << "#Max_thread: " << max_num_threads << std::endl;
       std::cout << "#Collectors: " << num_collectors << std::endl;
+      if (num_game_threads > 0) std::cout << "#Game threads: " << num_game_threads << std::endl;
+      if (! thread_affinity.empty()) std::cout << "Thread affinity: " << thread_affinity << std::endl;
       std::cout << "T: " << T << std::endl;
       if (verbose_comm) std::cout << "Comm Verbose On" << std::endl;
       if (verbose_collector) std::cout << "Comm Collector On" << std::endl;
       std::cout << "Wait per group: " << (wait_per_group ? "True" : "False") << std::endl;
+      if (batch_slots) std::cout << "Batch slots On" << std::endl;
+      if (batch_wait_budget_usec > 0) std::cout << "Adaptive batching, wait budget: " << batch_wait_budget_usec << "us" << std::endl;
+      if (num_buffers > 1) std::cout << "#Buffers per collector: " << num_buffers << std::endl;
+      if (base_seed != 0) std::cout << "Base seed: " << base_seed << std::endl;
       std::cout << mcts_options.info() << std::endl;
     }
 
-    REGISTER_PYBIND_FIELDS(num_games, max_num_threads, T, verbose_comm, verbose_collector, wait_per_group, mcts_options, num_collectors);
+    REGISTER_PYBIND_FIELDS(num_games, max_num_threads, T, verbose_comm, verbose_collector, wait_per_group, mcts_options, num_collectors, batch_slots, batch_wait_budget_usec, num_buffers, base_seed, num_game_threads, thread_affinity);
 };
 
 inline constexpr int get_query_id(int game_id, int thread_id) {
@@ -0,0 +1,41 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <random>
+#include <stdint.h>
+
+namespace elf {
+
+// splitmix64 finalizer. Nearby inputs (e.g. consecutive game indices) give unrelated outputs.
+inline uint64_t MixSeed(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Seed of game game_idx derived from base_seed. Different streams give independent seeds
+// for several generators of the same game. The result is in [1, 2^31 - 1], so it fits
+// the int seeds of the games and is never 0, which usually means "seed from the clock".
+inline int GameSeed(uint64_t base_seed, int game_idx, int stream = 0) {
+    uint64_t x = MixSeed(MixSeed(MixSeed(base_seed) + (uint64_t)game_idx) + (uint64_t)stream);
+    return (int)(x % 0x7fffffffULL) + 1;
+}
+
+// A fresh base seed, for runs that do not ask for a specific one.
+inline uint64_t RandomBaseSeed() {
+    std::random_device rd;
+    uint64_t t = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    uint64_t seed = MixSeed(((uint64_t)rd() << 32) ^ rd() ^ t);
+    return seed != 0 ? seed : 1;
+}
+
+}  // namespace elf
@@ -9,6 +9,7 @@
 //File: state_collector.h
 
 #pragma once
+#include <algorithm>
 #include <unordered_map>
 #include <vector>
 #include <iostream>
@@ -24,19 +25,23 @@
 #include "ctpl_stl.h"
 
 #include "primitive.h"
+#include "affinity.h"
 #include "collector.hh"
 #include "hist.h"
+#include "stats.h"
 
 template <typename Data>
 struct InfosT {
     int gid;
     std::vector<Data *> s;
+    // Which buffer set of the group holds the batch.
+    int buf_id;
 
-    InfosT(int gid, const std::vector<Data *> &s) : gid(gid), s(s) { }
-    InfosT() : gid(-1) { }
+    InfosT(int gid, const std::vector<Data *> &s, int buf_id = 0) : gid(gid), s(s), buf_id(buf_id) { }
+    InfosT() : gid(-1), buf_id(0) { }
     int batchsize() const { return (int)s.size(); }
 
-    REGISTER_PYBIND_FIELDS(gid, s);
+    REGISTER_PYBIND_FIELDS(gid, s, buf_id);
 };
 
 template <typename Data>
@@ -65,9 +70,9 @@ public:
         _queue_per_group.resize(num_groups);
     }
 
-    void push(int gid, const std::vector<Data *>& batch) {
-        if (_queue_per_group.empty() || gid == -1) _queue.enqueue(Infos(gid, batch));
-        else _queue_per_group[gid].enqueue(Infos(gid, batch));
+    void push(int gid, const std::vector<Data *>& batch, int buf_id = 0) {
+        if (_queue_per_group.empty() || gid == -1) _queue.enqueue(Infos(gid, batch, buf_id));
+        else _queue_per_group[gid].enqueue(Infos(gid, batch, buf_id));
     }
 
     // From the main thread.
@@ -152,49 +157,273 @@ public:
     using SyncSignal = SyncSignalT<Data>;
     using CopyItem = elf::CopyItemT<State>;
     using EntryFunc = std::function<EntryInfo (const std::string &key)>;
+    using ReplyHook = std::function<void (const Key &key)>;
 
 private:
+    // One set of shared buffers, and the batch it currently holds.
+    struct BatchBuffer {
+        std::vector<CopyItem> copier_input;
+        std::vector<CopyItem> copier_reply;
+
+        std::vector<In *> batch;
+        std::vector<Data *> batch_data;
+
+        bool in_use = false;
+        double fill_usec = 0;
+        std::chrono::steady_clock::time_point sent;
+    };
+
     const int _gid;
     // Here batchsize can be changed on demand.
     int _batchsize;
     CCQueue2<int> _batchsize_q;
     Semaphore<int> _batchsize_back;
 
-    // Current batch.
-    std::vector<In *> _batch;
-    std::vector<Data *> _batch_data;
     elf::BatchCollectorT<Key, In> _batch_collector;
 
-    std::vector<CopyItem> _copier_input;
-    std::vector<CopyItem> _copier_reply;
+    // Buffer sets allocated by Python. With more than one, the next batch is assembled
+    // while Python still consumes the previous one, and batches are released in Steps.
+    std::vector<BatchBuffer> _buffers;
 
     SyncSignal *_signal;
 
+    // Called after a game is resumed, if set.
+    ReplyHook _reply_hook;
+
+    // NUMA node of the collector thread, where its buffers are moved to. -1 if not pinned.
+    int _numa_node = -1;
+
     bool _verbose;
     int _timeout_usec;
 
+    // Batch size and timeouts chosen from the load, if a wait budget is set.
+    elf::AdaptiveBatchPolicy _policy;
+
     // Statistics
     int _num_enqueue;
 
+    // Always-on histograms, in usec except for the copies (nsec) and the batch size.
+    struct Stats {
+        // From SendData until the batch of the game is complete.
+        Histogram queue_wait;
+        // From the first to the last item of a batch.
+        Histogram batch_fill;
+        Histogram copy_to_mem, copy_from_mem;
+        // From sending the batch until the Python side calls Steps.
+        Histogram python_turnaround;
+        Histogram batchsize;
+    };
+    Stats _stats;
+
+    // Batch slot mode: games claim a slot and write their input into it (see CopyToSlot).
+    bool _batch_slots;
+    // Batchsize the buffers are allocated for, i.e. the stride between history steps.
+    const int _max_batchsize;
+
+    // Protects _stop, and the buffer states, the policy and the slots except in the single buffer queue mode.
+    std::mutex _mutex;
+    std::condition_variable _buffer_free, _slot_free, _slot_ready;
+    bool _stop = false;
+
+    // Game data (the In of each sample) is only touched under _games_mutex and until ReleaseGames,
+    // so that games woken up by the cancel token can exit and free it.
+    std::mutex _games_mutex;
+    bool _games_released = false;
+
+    // Slots of the buffer set _curr, which is being filled.
+    int _curr = 0;
+    bool _filling = false;
+    // Number of slots games may claim in the current batch.
+    int _slot_limit;
+    int _claimed = 0;
+    int _written = 0;
+    std::chrono::steady_clock::time_point _first_claim, _last_claim;
+
     // Wakeup signal.
     Semaphore<int> _wakeup;
 
     static constexpr int kTimeOutuSecNoBatch = 0;
 
+    // Whether batches are released by Steps instead of the collector waiting for them.
+    bool released_by_steps() const { return _batch_slots || _buffers.size() > 1; }
+
     void send_batch() {
         _wakeup.reset();
-        _signal->push(_gid, _batch_data);
+        _signal->push(_gid, _buffers[0].batch_data);
     }
 
-    int wait_batch_used() {
+    // False if the wait was cancelled.
+    bool wait_batch_used() {
         int future_timeout;
-        _wakeup.wait(&future_timeout);
-        return future_timeout;
+        return _wakeup.wait(&future_timeout);
+    }
+
+    // The stop entry from NotifyAwake, possibly mixed with real samples.
+    static bool has_stop_sample(const std::vector<In *> &batch) {
+        return std::find(batch.begin(), batch.end(), nullptr) != batch.end();
+    }
+
+    void send_buffer(int b) {
+        BatchBuffer &buf = _buffers[b];
+        buf.sent = std::chrono::steady_clock::now();
+        _signal->push(_gid, buf.batch_data, b);
+    }
+
+    // Take a free buffer set, -1 on stop.
+    int acquire_buffer(std::unique_lock<std::mutex> &lock) {
+        while (true) {
+            if (_stop) return -1;
+            for (size_t i = 0; i < _buffers.size(); ++i) {
+                if (! _buffers[i].in_use) {
+                    _buffers[i].in_use = true;
+                    return i;
+                }
+            }
+            _buffer_free.wait(lock);
+        }
+    }
+
+    // Copy the replies of buffer set b back, resume its games and free it. Called from Steps.
+    void release_buffer(int b) {
+        if (b < 0 || b >= (int)_buffers.size()) throw std::range_error("Invalid buffer " + std::to_string(b));
+        BatchBuffer &buf = _buffers[b];
+        double turnaround_usec = elapsed_usec(buf.sent);
+        _stats.python_turnaround.Add(turnaround_usec);
+
+        std::unique_lock<std::mutex> games_lock(_games_mutex);
+        std::vector<Key> keys;
+        if (! _games_released) {
+            auto copy_start = std::chrono::steady_clock::now();
+            if (_batch_slots) elf::CopyFromSlots(buf.copier_reply, buf.batch_data, _max_batchsize);
+            else elf::CopyFromMem(buf.copier_reply, buf.batch_data);
+            _stats.copy_from_mem.Add(elapsed_nsec(copy_start));
+
+            for (const In *in : buf.batch) keys.push_back(in->meta.query_id);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_policy.enabled()) _policy.Update(buf.batch.size(), _batchsize, buf.fill_usec, turnaround_usec);
+            buf.in_use = false;
+            _buffer_free.notify_all();
+        }
+
+        for (const Key &key : keys) {
+            _batch_collector.signalReply(key);
+            if (_reply_hook) _reply_hook(key);
+        }
+    }
+
+    void send_to_slot(In *data) {
+        int b, slot;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _slot_free.wait(lock, [this]() {
+                return _stop || (_filling && _claimed < _slot_limit);
+            });
+            if (_stop) return;
+            b = _curr;
+            slot = _claimed ++;
+            _last_claim = std::chrono::steady_clock::now();
+            if (slot == 0) _first_claim = _last_claim;
+        }
+
+        // Slots are disjoint, so games copy concurrently.
+        auto copy_start = std::chrono::steady_clock::now();
+        elf::CopyToSlot(_buffers[b].copier_input, data->data, slot, _max_batchsize);
+        _stats.copy_to_mem.Add(elapsed_nsec(copy_start));
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _buffers[b].batch[slot] = data;
+        _written ++;
+        _slot_ready.notify_one();
+    }
+
+    // Same batching rule as BatchCollectorT::waitBatch: wait for the first game forever,
+    // then for each next one up to timeout_usec() (0 = forever). Return false on stop.
+    bool wait_slots_written(std::unique_lock<std::mutex> &lock) {
+        while (! _stop) {
+            if (_claimed > 0 && _written == _claimed) {
+                if (_claimed >= _slot_limit) return true;
+                int timeout_usec = current_timeout_usec();
+                if (timeout_usec > 0) {
+                    auto deadline = _last_claim + std::chrono::microseconds(timeout_usec);
+                    if (_policy.enabled()) {
+                        deadline = std::min(deadline, _first_claim + std::chrono::microseconds(_policy.deadline_usec()));
+                    }
+                    if (std::chrono::steady_clock::now() >= deadline) return true;
+                    _slot_ready.wait_until(lock, deadline);
+                    continue;
+                }
+            }
+            _slot_ready.wait(lock);
+        }
+        return false;
+    }
+
+    // Start filling the slots of buffer set b.
+    void open_slots(int b) {
+        _curr = b;
+        _buffers[b].batch.assign(_max_batchsize, nullptr);
+        _claimed = 0;
+        _written = 0;
+        _slot_limit = std::min(current_batchsize(), _max_batchsize);
+        _filling = true;
+        _slot_free.notify_all();
+    }
+
+    int current_batchsize() const {
+        return _policy.enabled() ? _policy.batchsize(_batchsize) : _batchsize;
+    }
+
+    int current_timeout_usec() const {
+        return _policy.enabled() ? _policy.timeout_usec() : _timeout_usec;
+    }
+
+    static double elapsed_usec(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    static int64_t elapsed_nsec(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    void add_batch_stats(const BatchBuffer &buf) {
+        auto now = std::chrono::steady_clock::now();
+        for (const In *in : buf.batch) {
+            _stats.queue_wait.Add(std::chrono::duration_cast<std::chrono::microseconds>(now - in->sent_at).count());
+        }
+        _stats.batch_fill.Add(buf.fill_usec);
+        _stats.batchsize.Add(buf.batch.size());
+    }
+
+    void set_batch_data(BatchBuffer &buf) {
+        buf.batch_data.clear();
+        for (In *b : buf.batch) {
+            buf.batch_data.push_back(&b->data);
+        }
+    }
+
+    // Apply a batchsize sent by SetBatchSize, if any.
+    void check_batchsize() {
+        int new_batchsize;
+        if (_batchsize_q.wait_dequeue_timed(new_batchsize, 0)) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _batchsize = new_batchsize;
+            }
+            // std::cout << "CollectorGroup: get new batchsize. batchsize = " << _batchsize << std::endl;
+            _batchsize_back.notify(0);
+            // std::cout << "CollectorGroup: After notification. batchsize = " << _batchsize << std::endl;
+        }
     }
 
 public:
-    CollectorGroupT(int gid, const std::vector<Key> &keys, int batchsize, SyncSignal *signal, bool verbose, int timeout_usec)
-        : _gid(gid), _batchsize(batchsize), _batch_collector(keys), _signal(signal), _verbose(verbose), _timeout_usec(timeout_usec) {
+    CollectorGroupT(int gid, const std::vector<Key> &keys, int batchsize, SyncSignal *signal, bool verbose, int timeout_usec,
+                    bool batch_slots = false, int wait_budget_usec = 0, int num_buffers = 1)
+        : _gid(gid), _batchsize(batchsize), _batch_collector(keys), _buffers(std::max(num_buffers, 1)),
+          _signal(signal), _verbose(verbose), _timeout_usec(timeout_usec),
+          _policy(wait_budget_usec), _batch_slots(batch_slots), _max_batchsize(batchsize), _slot_limit(batchsize) {
     }
 
     EntryInfo GetEntry(const std::string &key, int hist_len, EntryFunc entry_func) const {
@@ -205,27 +434,58 @@ public:
         return entry_info;
     }
 
-    void AddEntry(const std::string &input_reply, const EntryInfo &e) {
+    void AddEntry(const std::string &input_reply, const EntryInfo &e, int buf_id = 0) {
+        if (buf_id < 0 || buf_id >= (int)_buffers.size()) {
+            throw std::range_error("Buffer " + std::to_string(buf_id) + " out of range, #buffers = " + std::to_string(_buffers.size()));
+        }
         std::vector<CopyItem> *copier = nullptr;
 
-        if (input_reply == "input") copier = &_copier_input;
-        else if (input_reply == "reply") copier = &_copier_reply;
+        if (input_reply == "input") copier = &_buffers[buf_id].copier_input;
+        else if (input_reply == "reply") copier = &_buffers[buf_id].copier_reply;
         else throw std::range_error("Unknown input_reply " + input_reply);
 
         auto *mm = State::get_mm(e.key);
         m_assert(mm != nullptr);
         copier->emplace_back(e.key, elf::SharedBuffer(e.p, e.byte_size), mm);
+
+        if (_numa_node >= 0 && ! elf::BindMemoryToNode((void *)e.p, e.byte_size, _numa_node)) {
+            std::cout << "Collector[" << _gid << "] cannot move " << e.key << " to NUMA node " << _numa_node << std::endl;
+        }
     }
 
     int gid() const { return _gid; }
 
+    // Set before MainLoop starts.
+    void SetReplyHook(ReplyHook hook) { _reply_hook = hook; }
+
+    // Set before MainLoop starts. Cancelling token stops the collector and the games waiting on it.
+    void SetCancel(CancelToken *token) {
+        _batch_collector.setCancel(token);
+        _wakeup.SetCancel(token);
+        _batchsize_back.SetCancel(token);
+        token->OnCancel([this]() { NotifyAwake(); });
+    }
+
+    // Set before the buffers are added.
+    void SetNumaNode(int node) { _numa_node = node; }
+    int num_buffers() const { return _buffers.size(); }
+
     std::string info() const {
         std::stringstream ss;
         ss << "Collector[" << _gid << "] Batchsize: " << _batchsize;
+        if (_buffers.size() > 1) ss << " Buffers: " << _buffers.size();
         return ss.str();
     }
 
     void SetBatchSize(int batchsize) {
+        if (_batch_slots) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _batchsize = batchsize;
+            _slot_limit = std::min(current_batchsize(), _max_batchsize);
+            _slot_free.notify_all();
+            _slot_ready.notify_one();
+            return;
+        }
         // std::cout << "[" << _gid << "] Before send batchsize " << batchsize << std::endl;
         _batchsize_q.enqueue(batchsize);
         int dummy;
@@ -238,62 +498,168 @@ public:
     void SendData(const Key &key, In *data) {
         if (_verbose) std::cout << "[" << key << "][" << _gid << "] c.SendData ... " << std::endl;
         // Collect data for this condition.
-        _batch_collector.sendData(key, data);
+        if (_batch_slots) send_to_slot(data);
+        else _batch_collector.sendData(key, data);
         _num_enqueue ++;
     }
 
-    void WaitReply(const Key &key) {
+    // False if cancelled before the reply came.
+    bool WaitReply(const Key &key) {
         V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] WaitReply for k = " << key);
-        _batch_collector.waitReply(key);
+        return _batch_collector.waitReply(key);
     }
 
     // Main Loop
     void MainLoop() {
+        if (_batch_slots) {
+            SlotLoop();
+            return;
+        }
+        if (_buffers.size() > 1) {
+            BufferLoop();
+            return;
+        }
         V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Starting MainLoop of collector, batchsize = " << _batchsize);
+        BatchBuffer &buf = _buffers[0];
         while (true) {
             // Wait until we have a complete batch.
-            int new_batchsize;
-            if (_batchsize_q.wait_dequeue_timed(new_batchsize, 0)) {
-                _batchsize = new_batchsize;
-                // std::cout << "CollectorGroup: get new batchsize. batchsize = " << _batchsize << std::endl;
-                _batchsize_back.notify(0);
-                // std::cout << "CollectorGroup: After notification. batchsize = " << _batchsize << std::endl;
-            }
-            _batch = _batch_collector.waitBatch(_batchsize, _timeout_usec, kTimeOutuSecNoBatch);
-            _batch_data.clear();
-            for (In *b : _batch) {
-                _batch_data.push_back(&b->data);
-            }
+            check_batchsize();
+            buf.batch = _batch_collector.waitBatch(current_batchsize(), current_timeout_usec(), kTimeOutuSecNoBatch,
+                    _policy.enabled() ? _policy.deadline_usec() : 0);
+            buf.fill_usec = _batch_collector.last_fill_usec();
 
             // Time to leave the loop.
-            if (_batch.size() == 1 && _batch[0] == nullptr) break;
-            if (_batch.empty()) continue;
+            if (has_stop_sample(buf.batch)) break;
+            if (buf.batch.empty()) continue;
+
+            std::unique_lock<std::mutex> games_lock(_games_mutex);
+            if (_games_released) break;
+            set_batch_data(buf);
 
-            V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Compute input. batchsize = " << _batch.size());
+            V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Compute input. batchsize = " << buf.batch.size());
+            add_batch_stats(buf);
 
-            elf::CopyToMem(_copier_input, _batch_data);
+            auto copy_start = std::chrono::steady_clock::now();
+            elf::CopyToMem(buf.copier_input, buf.batch_data);
+            _stats.copy_to_mem.Add(elapsed_nsec(copy_start));
+            games_lock.unlock();
 
             // Signal.
-            V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Send_batch. batchsize = " << _batch.size());
+            V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Send_batch. batchsize = " << buf.batch.size());
+            auto sent = std::chrono::steady_clock::now();
             send_batch();
 
             V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Wait until the batch is processed");
             // Wait until it is processed.
-            wait_batch_used();
+            if (! wait_batch_used()) break;
+            double turnaround_usec = elapsed_usec(sent);
+            _stats.python_turnaround.Add(turnaround_usec);
+            if (_policy.enabled()) _policy.Update(buf.batch.size(), _batchsize, buf.fill_usec, turnaround_usec);
 
             V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] PutReplies()");
 
-            elf::CopyFromMem(_copier_reply, _batch_data);
+            games_lock.lock();
+            if (_games_released) break;
+            copy_start = std::chrono::steady_clock::now();
+            elf::CopyFromMem(buf.copier_reply, buf.batch_data);
+            _stats.copy_from_mem.Add(elapsed_nsec(copy_start));
 
             // Finally make the game run again.
             V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Resume games");
-            for (In *in : _batch) {
+            for (In *in : buf.batch) {
                 const Key& key = in->meta.query_id;
                 V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Resume signal sent to k = " << key);
                 _batch_collector.signalReply(key);
+                if (_reply_hook) _reply_hook(key);
             }
 
-            V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] All resume signal sent, batchsize = " << _batch.size());
+            V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] All resume signal sent, batchsize = " << buf.batch.size());
+        }
+
+        V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Collector ends. Notify the upper level");
+        _signal->GetDoneNotif().notify();
+    }
+
+    // Several buffer sets: fill a free one while Python consumes the others.
+    void BufferLoop() {
+        V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Starting BufferLoop of collector, batchsize = " << _batchsize
+                << ", #buffers = " << _buffers.size());
+        while (true) {
+            check_batchsize();
+            int b, batchsize, timeout_usec, deadline_usec;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                b = acquire_buffer(lock);
+                if (b < 0) break;
+                batchsize = current_batchsize();
+                timeout_usec = current_timeout_usec();
+                deadline_usec = _policy.enabled() ? _policy.deadline_usec() : 0;
+            }
+            BatchBuffer &buf = _buffers[b];
+            buf.batch = _batch_collector.waitBatch(batchsize, timeout_usec, kTimeOutuSecNoBatch, deadline_usec);
+            buf.fill_usec = _batch_collector.last_fill_usec();
+
+            // Time to leave the loop.
+            if (has_stop_sample(buf.batch)) break;
+            if (buf.batch.empty()) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                buf.in_use = false;
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> games_lock(_games_mutex);
+                if (_games_released) break;
+                set_batch_data(buf);
+                add_batch_stats(buf);
+
+                auto copy_start = std::chrono::steady_clock::now();
+                elf::CopyToMem(buf.copier_input, buf.batch_data);
+                _stats.copy_to_mem.Add(elapsed_nsec(copy_start));
+            }
+
+            V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Send buffer " << b << ". batchsize = " << buf.batch.size());
+            send_buffer(b);
+        }
+
+        V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Collector ends. Notify the upper level");
+        _signal->GetDoneNotif().notify();
+    }
+
+    // Main loop of batch slot mode. The batch is ready once all claimed slots are written.
+    void SlotLoop() {
+        V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Starting SlotLoop of collector, batchsize = " << _batchsize);
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            int b = acquire_buffer(lock);
+            if (b >= 0) open_slots(b);
+        }
+        while (true) {
+            int b;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (! wait_slots_written(lock)) break;
+                _filling = false;
+                b = _curr;
+                BatchBuffer &buf = _buffers[b];
+                buf.batch.resize(_claimed);
+                buf.fill_usec = std::chrono::duration<double, std::micro>(_last_claim - _first_claim).count();
+            }
+            BatchBuffer &buf = _buffers[b];
+            {
+                std::lock_guard<std::mutex> games_lock(_games_mutex);
+                if (_games_released) break;
+                set_batch_data(buf);
+                add_batch_stats(buf);
+            }
+
+            V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Send buffer " << b << ". batchsize = " << buf.batch.size());
+            send_buffer(b);
+
+            // Games wait until a buffer set is free again.
+            std::unique_lock<std::mutex> lock(_mutex);
+            b = acquire_buffer(lock);
+            if (b < 0) break;
+            open_slots(b);
         }
 
         V_PRINT(_verbose, "CollectorGroup: [" << _gid << "] Collector ends. Notify the upper level");
@@ -301,30 +667,58 @@ public:
     }
 
     // Daemon side.
-    std::vector<Key> GetBatchKeys() const {
+    std::vector<Key> GetBatchKeys(int buf_id = 0) const {
         std::vector<Key> keys;
-        for (const In *in : _batch) {
+        if (buf_id < 0 || buf_id >= (int)_buffers.size()) return keys;
+        for (const In *in : _buffers[buf_id].batch) {
             keys.push_back(in->meta.query_id);
         }
         return keys;
     }
 
-    void SignalBatchUsed(int future_timeout) { _wakeup.notify(future_timeout); }
+    void SignalBatchUsed(int future_timeout, int buf_id = 0) {
+        if (released_by_steps()) release_buffer(buf_id);
+        else _wakeup.notify(future_timeout);
+    }
+
+    std::map<std::string, std::map<std::string, double>> GetStats() const {
+        return {
+            { "queue_wait_usec", _stats.queue_wait.Summary() },
+            { "batch_fill_usec", _stats.batch_fill.Summary() },
+            { "copy_to_mem_nsec", _stats.copy_to_mem.Summary() },
+            { "copy_from_mem_nsec", _stats.copy_from_mem.Summary() },
+            { "python_turnaround_usec", _stats.python_turnaround.Summary() },
+            { "batchsize", _stats.batchsize.Summary() },
+        };
+    }
 
     void PrintSummary() const {
-        /*
         std::cout << "Group[" << _gid << "]: " << std::endl;
-        std::cout << "[" << _gid << "]: #Enqueue: " << _num_enqueue << std::endl;
-        for (const auto& p : _conds) {
-            std::cout << "[" << _gid << "][" << p.first << "]: #Send[" << p.second.freq_send << "/"
-                      << (float)p.second.freq_send / _num_enqueue << "]" << std::endl;
+        for (const auto &h : GetStats()) {
+            const auto &v = h.second;
+            std::cout << "  " << h.first << ": count " << v.at("count") << ", mean " << v.at("mean")
+                      << ", p50 " << v.at("p50") << ", p99 " << v.at("p99") << ", max " << v.at("max") << std::endl;
         }
-        */
     }
 
-    // For other thread.
+    // For other threads. Called before the cancel token fires. Once it returns, the collector no
+    // longer touches game data.
+    void ReleaseGames() {
+        std::lock_guard<std::mutex> lock(_games_mutex);
+        _games_released = true;
+    }
+
+    // Called on cancel and again by CommT::Stop, only the first call does anything.
     void NotifyAwake() {
-        // Kick the collector out of the waiting state by sending fake samples.
-        _batch_collector.sendData(0, nullptr);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stop) return;
+            _stop = true;
+            _buffer_free.notify_all();
+            _slot_free.notify_all();
+            _slot_ready.notify_one();
+        }
+        // Kick the collector out of the waiting state with a stop entry, which is not any game's slot.
+        if (! _batch_slots) _batch_collector.sendStop();
     }
 };
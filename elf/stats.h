@@ -8,6 +8,89 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <stdint.h>
+
+// Lock-free histogram of non-negative integers (e.g. usec). Buckets are 4 per power of 2,
+// so percentiles are within 25%. Add() costs a few relaxed atomic adds and may be called from any thread.
+class Histogram {
+public:
+    static constexpr int kNumBuckets = 252;
+
+    Histogram() { Reset(); }
+
+    void Add(int64_t v) {
+        if (v < 0) v = 0;
+        _buckets[_bucket(v)].fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(v, std::memory_order_relaxed);
+        int64_t m = _max.load(std::memory_order_relaxed);
+        while (v > m && ! _max.compare_exchange_weak(m, v, std::memory_order_relaxed)) { }
+    }
+
+    void Reset() {
+        for (auto &b : _buckets) b.store(0, std::memory_order_relaxed);
+        _sum = 0;
+        _max = 0;
+    }
+
+    // count, mean, p50, p90, p99 and max.
+    std::map<std::string, double> Summary() const {
+        uint64_t counts[kNumBuckets];
+        uint64_t total = 0;
+        for (int i = 0; i < kNumBuckets; ++i) {
+            counts[i] = _buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        double max_value = _max.load();
+        std::map<std::string, double> res;
+        res["count"] = total;
+        res["mean"] = total > 0 ? (double)_sum.load() / total : 0.0;
+        res["p50"] = std::min(max_value, _percentile(counts, total, 0.5));
+        res["p90"] = std::min(max_value, _percentile(counts, total, 0.9));
+        res["p99"] = std::min(max_value, _percentile(counts, total, 0.99));
+        res["max"] = max_value;
+        return res;
+    }
+
+private:
+    std::atomic<uint64_t> _buckets[kNumBuckets];
+    std::atomic<int64_t> _sum, _max;
+
+    // Values 0-3 have their own bucket, then v in [2^e, 2^(e+1)) goes to 4 * (e - 1) + next two bits.
+    static int _bucket(uint64_t v) {
+        if (v < 4) return v;
+        int e = 63 - __builtin_clzll(v);
+        return 4 * (e - 1) + ((v >> (e - 2)) & 3);
+    }
+
+    // Middle of the bucket, exact for buckets of a single value.
+    static double _value(int b) {
+        if (b < 4) return b;
+        int e = b / 4 + 1;
+        double width = (double)(1ull << (e - 2));
+        double lo = (4 + b % 4) * width;
+        return width == 1 ? lo : lo + width / 2;
+    }
+
+    static double _percentile(const uint64_t *counts, uint64_t total, double q) {
+        if (total == 0) return 0.0;
+        uint64_t rank = (uint64_t)(q * total);
+        if (rank >= total) rank = total - 1;
+        uint64_t acc = 0;
+        for (int i = 0; i < kNumBuckets; ++i) {
+            acc += counts[i];
+            if (acc > rank) return _value(i);
+        }
+        return _value(kNumBuckets - 1);
+    }
+};
+
 class CommStats {
 private:
     // std::mutex _mutex;
@@ -8,6 +8,11 @@
 
 #include "tar_loader.h"
 #include <memory.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
 
 namespace elf {
 
@@ -18,32 +23,62 @@ bool file_is_tar(const std::string& filename) {
 }
 
 TarLoader::TarLoader(const std::string &tar_filename) {
-  mtar_open(&tar, tar_filename.c_str(), "r");
-}
-
-std::vector<std::string> TarLoader::List() {
-  std::vector<std::string> v;
+  mtar_t tar;
+  if (mtar_open(&tar, tar_filename.c_str(), "r") != MTAR_ESUCCESS) {
+    std::cout << "Cannot open tar file " << tar_filename << std::endl;
+    return;
+  }
   mtar_header_t h;
-  while ((mtar_read_header(&tar, &h)) != MTAR_ENULLRECORD) {
-    v.push_back(std::string(h.name));
+  while (mtar_read_header(&tar, &h) == MTAR_ESUCCESS) {
+    // Old V7 and GNU archives mark regular files with '\0', which microtar does not normalize.
+    if (h.type == MTAR_TREG || h.type == '\0') {
+      // Data follows the 512-byte header.
+      index[h.name] = names.size();
+      names.push_back(h.name);
+      members.push_back(std::make_pair(tar.last_header + 512, h.size));
+    }
     mtar_next(&tar);
   }
-  return v;
+  mtar_close(&tar);
+
+  int fd = open(tar_filename.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+    data_size = st.st_size;
+    data = mmap(nullptr, data_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) data = nullptr;
+  }
+  if (fd >= 0) close(fd);
+  if (data == nullptr) {
+    std::cout << "Cannot map tar file " << tar_filename << std::endl;
+    names.clear();
+    members.clear();
+    index.clear();
+  }
 }
 
-std::string TarLoader::Load(const std::string &filename) {
-  mtar_header_t h;
-  mtar_find(&tar, filename.c_str(), &h);
-  char *s = new char[h.size + 1];
-  ::memset(s, 0, h.size + 1);
-  mtar_read_data(&tar, s, h.size);
-  std::string res(s);
-  delete [] s;
-  return res;
+std::pair<const char *, size_t> TarLoader::View(const std::string &filename) const {
+  auto it = index.find(filename);
+  if (it == index.end()) return std::make_pair(nullptr, 0);
+  const auto &m = members[it->second];
+  if (m.first + m.second > data_size) return std::make_pair(nullptr, 0);
+  return std::make_pair((const char *)data + m.first, m.second);
+}
+
+std::string TarLoader::Load(const std::string &filename) const {
+  auto v = View(filename);
+  if (v.first == nullptr) return std::string();
+  return std::string(v.first, v.second);
+}
+
+void TarLoader::ForEach(std::function<void (const std::string &, const std::string &)> f) const {
+  for (size_t i = 0; i < names.size(); ++i) {
+    f(names[i], Load(names[i]));
+  }
 }
 
 TarLoader::~TarLoader() {
-    mtar_close(&tar);
+  if (data != nullptr) munmap(data, data_size);
 }
 
 TarWriter::TarWriter(const std::string &tar_filename) {
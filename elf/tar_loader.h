@@ -10,6 +10,9 @@
 
 #include <string>
 #include <vector>
+#include <functional>
+#include <unordered_map>
+#include <utility>
 #include "microtar.h"
 
 namespace elf {
@@ -18,13 +21,29 @@ namespace tar {
 
 extern bool file_is_tar(const std::string& filename);
 
+// The archive is indexed (name -> data offset) when opened and mmapped, so that lookups are
+// O(1) and reads do not copy. All read functions are const and thread-safe.
 class TarLoader {
 private:
-  mtar_t tar;
+  // Members in archive order.
+  std::vector<std::string> names;
+  std::vector<std::pair<size_t, size_t>> members;
+  std::unordered_map<std::string, size_t> index;
+
+  void *data = nullptr;
+  size_t data_size = 0;
+
 public:
   TarLoader(const std::string &tar_filename);
-  std::vector<std::string> List();
-  std::string Load(const std::string &filename);
+  // Owns the mapping.
+  TarLoader(const TarLoader &) = delete;
+  TarLoader &operator=(const TarLoader &) = delete;
+  std::vector<std::string> List() const { return names; }
+  // (ptr, size) of a member inside the mapping, valid while the loader lives. (nullptr, 0) if not found.
+  std::pair<const char *, size_t> View(const std::string &filename) const;
+  std::string Load(const std::string &filename) const;
+  // Read all files in archive order, in a single pass.
+  void ForEach(std::function<void (const std::string &, const std::string &)> f) const;
   ~TarLoader();
 };
 
@@ -14,6 +14,11 @@
 #include <string>
 #include <fstream>
 #include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <thread>
 
 #include "member_check.h"
 #include "utils.h"
@@ -30,7 +35,10 @@
  * s.set_thread(int i). Set the thread idx.
  * bool s.forward(const A& a). Forward function that changes the current state to the next state. Return false if the current state is terminal.
  * float s.reward(). Get a reward given the current state.
- * s.evaluate(). Evaluate the current state to get pi/V.
+ * bool s.evaluate(state, &resp). Evaluate the state to get pi/V. Returns false if the reply did not come, then the rollout stops.
+ * s.GetHash(). Optional. 64-bit hash of the state, used when TSOptions::use_transposition_table is set.
+ * s.evaluate_batch(states, resps). Optional. Evaluate several leaves at once when TSOptions::leaf_batch_size > 1.
+ *   Returns false if the replies did not come, then the leaves are dropped.
  * s.pi(): return vector<pair<A, float>> for the candidate actions and its prob.
  * s.value(): return a float for the value of current state.
  *
@@ -41,7 +49,12 @@ namespace mcts {
 using namespace std;
 
 struct RunInfo {
-    int num_rollout;
+    int num_rollout = 0;
+    // Stop at the deadline, if use_deadline is set.
+    bool use_deadline = false;
+    chrono::steady_clock::time_point deadline;
+    // Rollouts shared by all threads, if not nullptr.
+    atomic<int> *rollouts_left = nullptr;
 };
 
 template <typename S, typename A>
@@ -63,6 +76,15 @@ public:
         state_ready_.notify(info);
     }
 
+    // Called by TreeSearchT before the threads are notified, so no search is running.
+    template <typename Actor, typename Rng>
+    void AddRootNoise(Actor &actor, NodeAlloc &alloc, Rng &rng) {
+        Node *root = alloc.root();
+        if (root == nullptr || root->s_ptr() == nullptr) return;
+        if (_visit(actor, root, alloc) == Node::NODE_NOT_VISITED) return;
+        root->AddPriorNoise(options_.dirichlet_epsilon, options_.dirichlet_alpha, rng);
+    }
+
     template <typename Actor>
     bool Run(int run_id, const atomic_bool *done, Actor &actor, NodeAlloc &alloc) {
         RunInfo info;
@@ -83,48 +105,131 @@ public:
 
         PRINT_MAIN("Start. actor thread_id: " << actor.info());
 
-        for (int iter = 0; iter < info.num_rollout && (done == nullptr || ! done->load()); ++iter) {
-            // Start from the root and run one path
-            vector<pair<Node *, A>> traj;
-            Node *node = root;
-
-            int depth = 0;
-
-            while (_visit(actor, node, alloc) == Node::NODE_ALREADY_VISITED) {
-                A a = UCT(node->sa(), node->count(), options_.use_prior, output_.get()).first;
-                PRINT_TS("[depth=" << depth << "] Action: " << a);
-
-                // Save trajectory.
-                traj.push_back(make_pair(node, a));
-                NodeId next = node->Descent(a);
-                PRINT_TS("[depth=" << depth << "] Descent node id: " << next);
+        const int batch_size = std::max(options_.leaf_batch_size, 1);
+        const bool batched = batch_size > 1;
+        // Leaves in one batch are only different if each pending path is penalized.
+        const int virtual_loss = batched ? std::max(options_.virtual_loss, 1) : options_.virtual_loss;
+
+        // In batched mode leaves are only expanded after the batch is evaluated, so the root has to be ready first.
+        if (batched && _visit(actor, root, alloc) == Node::NODE_NOT_VISITED) return false;
+
+        // Rollouts backpropagated so far. Leaf collisions do not use the budget, they are counted
+        // apart since the last backprop.
+        int iter = 0;
+        int collisions = 0;
+        bool budget_left = true;
+        while (budget_left && (done == nullptr || ! done->load())) {
+            vector<pair<vector<pair<Node *, int>>, Node *>> pending;
+
+            while ((int)pending.size() < batch_size) {
+                if (! _next_rollout(info, iter + (int)pending.size())) {
+                    budget_left = false;
+                    break;
+                }
+                // Start from the root and run one path
+                vector<pair<Node *, int>> traj;
+                Node *node = root;
+
+                int depth = 0;
+                typename Node::VisitType visit = Node::NODE_ALREADY_VISITED;
+
+                while (batched ? node->visited() : (visit = _visit(actor, node, alloc)) == Node::NODE_ALREADY_VISITED) {
+                    int idx = UCT(node->sa(), node->count(), options_.use_prior,
+                            options_.c_puct, options_.first_play_urgency, output_.get()).first;
+                    if (idx < 0) break;
+                    const A &a = node->sa()[idx].first;
+                    PRINT_TS("[depth=" << depth << "] Action: " << a);
+
+                    // Save trajectory.
+                    traj.push_back(make_pair(node, idx));
+                    if (virtual_loss != 0) node->AddVirtualLoss(idx, virtual_loss);
+                    NodeId next = node->DescentAt(idx);
+                    PRINT_TS("[depth=" << depth << "] Descent node id: " << next);
+
+                    assert(node->s_ptr());
+
+                    // Note that next might be invalid, if there is not valid move.
+                    Node *next_node = alloc[next];
+                    if (next_node == nullptr) break;
+
+                    PRINT_TS("[depth=" << depth << "] Before forward. ");
+                    if (! _forward(node, a, actor, next_node)) break;
+                    PRINT_TS("[depth=" << depth << "] After forward. ");
+                    if (options_.use_transposition_table) {
+                        next_node = _transpose(traj, idx, next, next_node, alloc);
+                        // The position repeats along the path, stop here.
+                        if (next_node == nullptr) break;
+                    }
+                    node = next_node;
+                    PRINT_TS("[depth=" << depth << "] Next node address: " << hex << node << dec);
+                    depth ++;
+                }
 
-                assert(node->s_ptr());
+                if (visit == Node::NODE_NOT_VISITED) {
+                    // No reply (e.g., the game is stopping). Leave the leaf unvisited and drop the path without backprop.
+                    PRINT_TS("Evaluation failed, drop the path");
+                    for (const auto &p : traj) {
+                        p.first->AddVirtualLoss(p.second, -virtual_loss);
+                    }
+                    return false;
+                }
 
-                // Note that next might be invalid, if there is not valid move.
-                Node *next_node = alloc[next];
-                if (next_node == nullptr) break;
+                if (batched && ! node->visited()) {
+                    if (node->ClaimExpansion()) {
+                        PRINT_TS("Leaf queued for evaluation, batch size: " << pending.size() + 1);
+                        pending.emplace_back(std::move(traj), node);
+                        continue;
+                    }
+                    // Another path is already waiting for this leaf. Take back the virtual loss, give the
+                    // rollout back and flush the batch.
+                    PRINT_TS("Leaf collision, flush batch of size " << pending.size());
+                    for (const auto &p : traj) {
+                        p.first->AddVirtualLoss(p.second, -virtual_loss);
+                    }
+                    _return_rollout(info);
+                    collisions ++;
+                    if (options_.max_leaf_collisions > 0 && collisions >= options_.max_leaf_collisions) {
+                        PRINT_TS("Too many leaf collisions: " << collisions);
+                        budget_left = false;
+                    }
+                    // Nothing of ours to flush: the leaf waits for another thread, give it the cpu.
+                    if (pending.empty()) std::this_thread::yield();
+                    break;
+                }
 
-                PRINT_TS("[depth=" << depth << "] Before forward. ");
-                if (! _forward(node, a, actor, next_node)) break;
-                PRINT_TS("[depth=" << depth << "] After forward. ");
-                node = next_node;
-                PRINT_TS("[depth=" << depth << "] Next node address: " << hex << node << dec);
-                depth ++;
+                // Now the node points to a recently created node.
+                // Evaluate it and backpropagate.
+                _backprop(traj, get_reward(actor, node), virtual_loss);
+                iter ++;
+                collisions = 0;
+                PRINT_TS("Done backprop");
             }
 
-            // Now the node points to a recently created node.
-            // Evaluate it and backpropagate.
-            float reward = get_reward(actor, node);
+            if (pending.empty()) continue;
 
-            PRINT_TS("Reward: " << reward << " Start backprop");
+            vector<const S *> states;
+            for (const auto &p : pending) states.push_back(p.second->s_ptr());
 
-            // Add reward back.
-            for (const auto &p : traj) {
-                p.first->AccumulateStats(p.second, reward);
+            vector<NodeResponseT<A>> resps(states.size());
+            if (! _evaluate_batch(actor, states, &resps)) {
+                // No replies (e.g., the game is stopping). Drop the pending leaves without backprop.
+                PRINT_TS("Batch evaluation failed, drop " << pending.size() << " leaves");
+                for (const auto &p : pending) {
+                    for (const auto &e : p.first) e.first->AddVirtualLoss(e.second, -virtual_loss);
+                    p.second->ReleaseExpansion();
+                }
+                return false;
             }
 
-            PRINT_TS("Done backprop");
+            auto init = [&](EdgeInfo &info) { _init_edge(info); };
+            for (size_t i = 0; i < pending.size(); ++i) {
+                Node *node = pending[i].second;
+                node->Expand(resps[i], init, alloc);
+                _backprop(pending[i].first, get_reward(actor, node), virtual_loss);
+                iter ++;
+                collisions = 0;
+            }
+            PRINT_TS("Done batch backprop, batch size: " << pending.size());
         }
 
         PRINT_MAIN("Done");
@@ -141,12 +246,26 @@ private:
     Semaphore<RunInfo> state_ready_;
     std::unique_ptr<ostream> output_;
 
+    // Pseudo games. Seeded with the thread id.
     std::mt19937 rng_;
 
     static float sigmoid(float x) {
         return 1.0 / (1 + exp(-x));
     }
 
+    // Whether the budgets in info allow another rollout. Takes one from the shared rollout budget.
+    bool _next_rollout(const RunInfo &info, int iter) const {
+        if (iter >= info.num_rollout) return false;
+        if (info.use_deadline && chrono::steady_clock::now() >= info.deadline) return false;
+        if (info.rollouts_left != nullptr && info.rollouts_left->fetch_sub(1) <= 0) return false;
+        return true;
+    }
+
+    // Undo the shared budget taken by _next_rollout() for a rollout that did not finish.
+    void _return_rollout(const RunInfo &info) const {
+        if (info.rollouts_left != nullptr) info.rollouts_left->fetch_add(1);
+    }
+
     MEMBER_FUNC_CHECK(reward)
     template <typename Actor, typename std::enable_if<has_func_reward<Actor>::value>::type *U = nullptr>
     float get_reward(const Actor &actor, const Node *node) {
@@ -183,16 +302,69 @@ private:
       return next_node->SetStateIfNull(func);
     }
 
+    static bool _on_path(const vector<pair<Node *, int>> &traj, const Node *n) {
+        for (const auto &p : traj) {
+            if (p.first == n) return true;
+        }
+        return false;
+    }
+
+    // The first time a node is reached, look up its state in the transposition table.
+    // If an equivalent node exists, the edge is redirected to it.
+    // Return the node to continue with, or nullptr if it is already on the path.
+    MEMBER_FUNC_CHECK(GetHash)
+    template <typename S_ = S, typename std::enable_if<has_func_GetHash<S_>::value>::type *U = nullptr>
+    Node *_transpose(const vector<pair<Node *, int>> &traj, int idx, NodeId next, Node *next_node, NodeAlloc &alloc) {
+        if (next_node->MarkInTable()) {
+            NodeId id = alloc.Transpose(next_node->s_ptr()->GetHash(), next);
+            Node *node = alloc[id];
+            if (id != next && ! _on_path(traj, node)) {
+                traj.back().first->SetChild(idx, id);
+                next_node = node;
+            }
+        }
+        return _on_path(traj, next_node) ? nullptr : next_node;
+    }
+
+    template <typename S_ = S, typename std::enable_if<! has_func_GetHash<S_>::value>::type *U = nullptr>
+    Node *_transpose(const vector<pair<Node *, int>> &, int, NodeId, Node *next_node, NodeAlloc &) {
+        return next_node;
+    }
+
+    MEMBER_FUNC_CHECK(evaluate_batch)
+    template <typename Actor, typename std::enable_if<has_func_evaluate_batch<Actor>::value>::type *U = nullptr>
+    bool _evaluate_batch(Actor &actor, const vector<const S *> &states, vector<NodeResponseT<A>> *resps) {
+        return actor.evaluate_batch(states, resps);
+    }
+
+    template <typename Actor, typename std::enable_if<! has_func_evaluate_batch<Actor>::value>::type *U = nullptr>
+    bool _evaluate_batch(Actor &actor, const vector<const S *> &states, vector<NodeResponseT<A>> *resps) {
+        for (size_t i = 0; i < states.size(); ++i) {
+            if (! actor.evaluate(*states[i], &(*resps)[i])) return false;
+        }
+        return true;
+    }
+
+    void _backprop(const vector<pair<Node *, int>> &traj, float reward, int virtual_loss) {
+        // Add reward back.
+        for (const auto &p : traj) {
+            p.first->AccumulateStats(p.second, reward, virtual_loss);
+        }
+    }
+
+    void _init_edge(EdgeInfo &info) {
+        info.acc_reward = rng_() % (options_.pseudo_games + 1);
+        info.n = options_.pseudo_games;
+    }
+
     template <typename Actor>
     typename Node::VisitType _visit(Actor &actor, Node *node, NodeAlloc &alloc) {
         // Check
-        auto func = [&](const Node *n) -> NodeResponseT<A> & {
-            return actor.evaluate(*n->s_ptr());
-        };
-        auto init = [&](EdgeInfo &info) {
-             info.acc_reward = rng_() % (options_.pseudo_games + 1);
-             info.n = options_.pseudo_games;
+        NodeResponseT<A> resp;
+        auto func = [&](const Node *n) -> const NodeResponseT<A> * {
+            return actor.evaluate(*n->s_ptr(), &resp) ? &resp : nullptr;
         };
+        auto init = [&](EdgeInfo &info) { _init_edge(info); };
         return node->ExpandIfNecessary(func, init, alloc);
     }
 };
@@ -207,7 +379,8 @@ public:
     using MCTSResult = MCTSResultT<A>;
 
     TreeSearchT(const TSOptions &options, std::function<Actor *(int)> actor_gen)
-        : pool_(options.num_threads), options_(options) {
+        : pool_(options.num_threads), options_(options),
+          noise_rng_(options.seed != 0 ? (unsigned)options.seed : std::random_device{}()) {
 
         for (int i = 0; i < options.num_threads; ++i) {
             threads_.emplace_back(new TSOneThread(i, options_));
@@ -236,10 +409,23 @@ public:
     }
 
     Actor &actor(int i) { return *actors_[i]; }
+    const NodeAlloc &alloc() const { return alloc_; }
     size_t size() const { return actors_.size(); }
     string info() const { return alloc_.root()->info(alloc_); }
 
     MCTSResult Run(const S& root_state) {
+        RunInfo run_info;
+        run_info.num_rollout = options_.num_rollout_per_thread;
+        if (options_.time_budget_ms > 0) {
+            run_info.use_deadline = true;
+            run_info.deadline = chrono::steady_clock::now() + chrono::milliseconds(options_.time_budget_ms);
+        }
+        if (options_.num_rollouts > 0) {
+            run_info.num_rollout = std::numeric_limits<int>::max();
+            rollouts_left_ = options_.num_rollouts;
+            run_info.rollouts_left = &rollouts_left_;
+        }
+
         Node *root = alloc_.root();
         if (root == nullptr) {
             cout << "TreeSearch::root cannot be null!" << endl;
@@ -247,7 +433,10 @@ public:
         }
         root->SetStateIfNull([&]() { return new S(root_state); });
 
-        notify_state_ready(options_.num_rollout_per_thread);
+        // Worker threads are all waiting, so thread 0's actor can be used here.
+        if (options_.dirichlet_epsilon > 0) threads_[0]->AddRootNoise(*actors_[0], alloc_, noise_rng_);
+
+        notify_state_ready(run_info);
 
         // Wait until all tree searches are done.
         tree_ready_.wait(pool_.size());
@@ -261,6 +450,9 @@ public:
 
         // Pick the best solution.
         MCTSResult result;
+        // The root could not be evaluated, there is nothing to pick.
+        if (root->sa().empty()) return result;
+
         if (options_.pick_method == "strongest_prior") result = StrongestPrior(root->sa());
         else if (options_.pick_method == "most_visited") result = MostVisited(root->sa());
         else if (options_.pick_method == "uniform_random") result = UniformRandom(root->sa());
@@ -291,10 +483,12 @@ public:
         done_.set();
 
         // cout << "About to send notify in Stop " << endl;
-        notify_state_ready(0);
-
-        tree_ready_.wait(pool_.size());
+        RunInfo info;
+        info.num_rollout = 0;
+        notify_state_ready(info);
 
+        // A thread that sees done_ before its next Run() exits without notifying tree_ready_,
+        // so only wait until all threads are done.
         done_.wait(pool_.size());
     }
 
@@ -313,14 +507,15 @@ private:
     NodeAlloc alloc_;
 
     RunInfo run_info_;
+    atomic<int> rollouts_left_{0};
 
     TSOptions options_;
+    // Root noise, seeded per game from options.seed.
+    std::mt19937 noise_rng_;
     Notif done_;
     SemaCollector tree_ready_;
 
-    void notify_state_ready(int num_rollout) {
-        RunInfo info;
-        info.num_rollout = num_rollout;
+    void notify_state_ready(const RunInfo &info) {
         for (size_t i = 0; i < threads_.size(); ++i) {
             threads_[i]->NotifyReady(info);
         }
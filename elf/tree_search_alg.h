@@ -6,6 +6,7 @@
 * LICENSE file in the root directory of this source tree.
 */
 
+#include <cmath>
 #include <type_traits>
 #include "tree_search_base.h"
 
@@ -14,44 +15,39 @@ namespace mcts {
 using namespace std;
 
 // Algorithms.
-template <typename Map>
-pair<typename Map::key_type, float> UCT(const Map& vals, float count, bool use_prior = true, ostream *oo = nullptr) {
+// Return the index of the best child (-1 if there is none) and its score.
+template <typename A>
+pair<int, float> UCT(const ChildrenT<A>& vals, float count, bool use_prior = true,
+        float c_puct = 0.5, float first_play_urgency = 0.5, ostream *oo = nullptr) {
     // Simple PUCT algorithm.
-    using A = typename Map::key_type;
-    static_assert(is_same<typename Map::mapped_type, EdgeInfo>::value, "key type must be EdgeInfo");
-
-    A best_a = A();
+    int best_idx = -1;
     float max_score = std::numeric_limits<float>::lowest();
-    const float c_puct = 0.5;
     const float sqrt_count1 = sqrt(count + 1);
 
     if (oo) *oo << "UCT prior = " << (use_prior ? "True" : "False") << endl;
 
-    for (const auto& action_pair : vals) {
-        const A& a = action_pair.first;
-        const EdgeInfo &info = action_pair.second;
+    for (size_t i = 0; i < vals.size(); ++i) {
+        const EdgeInfo &info = vals[i].second;
 
-        float score = (info.acc_reward + 0.5) / (info.n + 1);
+        float score = info.n == 0 ? first_play_urgency : (info.acc_reward + 0.5) / (info.n + 1);
         if (use_prior) score += c_puct * info.prior / (1 + info.n) * sqrt_count1;
 
-        if (oo) *oo << "UCT [a=" << a << "] prior: " << info.prior << " score: " <<  score << endl;
+        if (oo) *oo << "UCT [a=" << vals[i].first << "] prior: " << info.prior << " score: " <<  score << endl;
 
         if (score > max_score) {
             max_score = score;
-            best_a = a;
+            best_idx = i;
         }
     }
-    return make_pair(best_a, max_score);
+    return make_pair(best_idx, max_score);
 };
 
-template <typename Map>
-MCTSResultT<typename Map::key_type> MostVisited(const Map& vals) {
-    using A = typename Map::key_type;
+template <typename A>
+MCTSResultT<A> MostVisited(const ChildrenT<A>& vals) {
     using MCTSResult = MCTSResultT<A>;
-    static_assert(is_same<typename Map::mapped_type, EdgeInfo>::value, "key type must be EdgeInfo");
 
     MCTSResult res;
-    for (const pair<A, EdgeInfo> & action_pair : vals) {
+    for (const auto &action_pair : vals) {
         const EdgeInfo &info = action_pair.second;
 
         res.feed(info.n, action_pair);
@@ -59,14 +55,12 @@ MCTSResultT<typename Map::key_type> MostVisited(const Map& vals) {
     return res;
 };
 
-template <typename Map>
-MCTSResultT<typename Map::key_type> StrongestPrior(const Map& vals) {
-    using A = typename Map::key_type;
+template <typename A>
+MCTSResultT<A> StrongestPrior(const ChildrenT<A>& vals) {
     using MCTSResult = MCTSResultT<A>;
-    static_assert(is_same<typename Map::mapped_type, EdgeInfo>::value, "key type must be EdgeInfo");
 
     MCTSResult res;
-    for (const pair<A, EdgeInfo> & action_pair : vals) {
+    for (const auto &action_pair : vals) {
         const EdgeInfo &info = action_pair.second;
 
         res.feed(info.prior, action_pair);
@@ -74,11 +68,9 @@ MCTSResultT<typename Map::key_type> StrongestPrior(const Map& vals) {
     return res;
 };
 
-template <typename Map>
-MCTSResultT<typename Map::key_type> UniformRandom(const Map& vals) {
-    using A = typename Map::key_type;
+template <typename A>
+MCTSResultT<A> UniformRandom(const ChildrenT<A>& vals) {
     using MCTSResult = MCTSResultT<A>;
-    static_assert(is_same<typename Map::mapped_type, EdgeInfo>::value, "key type must be EdgeInfo");
 
     static std::mt19937 rng(time(NULL));
     static std::mutex mu;
@@ -90,10 +82,7 @@ MCTSResultT<typename Map::key_type> UniformRandom(const Map& vals) {
         lock_guard<mutex> lock(mu);
         idx = rng() % vals.size();
     }
-    auto it = vals.begin();
-    while (--idx >= 0) ++ it;
-
-    res.feed(it->second.n, *it);
+    res.feed(vals[idx].second.n, vals[idx]);
     return res;
 };
 
@@ -8,8 +8,10 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <unordered_map>
+#include <vector>
 #include <string>
 #include <sstream>
 
@@ -32,21 +34,53 @@ using EvalFuncT = function<float (const S &s)>;
 struct EdgeInfo {
     // From state.
     float prior;
-    NodeId next;
+    // Redirected by the transposition table while other threads descend through it.
+    atomic<NodeId> next;
 
     // Accumulated reward and #trial.
+#ifdef MCTS_ATOMIC_EDGE
+    // Updated without the node lock. n and acc_reward are separate atomics and may be briefly out of sync.
+    atomic<float> acc_reward;
+    atomic<int> n;
+#else
     float acc_reward;
     int n;
+#endif
 
     EdgeInfo(float p = 0.0) : prior(p), next(NodeIdInvalid), acc_reward(0), n(0) { }
+    EdgeInfo(const EdgeInfo &other)
+        : prior(other.prior), next(other.next.load()), acc_reward((float)other.acc_reward), n((int)other.n) { }
+
+    EdgeInfo &operator=(const EdgeInfo &other) {
+        prior = other.prior;
+        next = other.next.load();
+        acc_reward = (float)other.acc_reward;
+        n = (int)other.n;
+        return *this;
+    }
+
+    // Without MCTS_ATOMIC_EDGE the caller has to hold the node lock.
+    void Add(float reward, int trials) {
+#ifdef MCTS_ATOMIC_EDGE
+        float curr = acc_reward.load();
+        while (! acc_reward.compare_exchange_weak(curr, curr + reward)) { }
+#else
+        acc_reward += reward;
+#endif
+        n += trials;
+    }
 
     string info() const {
         std::stringstream ss;
-        ss << acc_reward << "/" << n << " (" << acc_reward / n << "), Pr: " << prior << ", next: " << next;
+        ss << (float)acc_reward << "/" << (int)n << " (" << acc_reward / n << "), Pr: " << prior << ", next: " << next.load();
         return ss.str();
     }
 };
 
+// Children of a node. Expanded once, then only the statistics change.
+template <typename A>
+using ChildrenT = vector<pair<A, EdgeInfo>>;
+
 template <typename A>
 struct MCTSResultT {
     A best_a;
@@ -66,6 +100,9 @@ struct MCTSResultT {
       return false;
     }
 
+    // False if nothing was fed, e.g., the root could not be evaluated.
+    bool found() const { return max_score > std::numeric_limits<float>::lowest(); }
+
     string info() const {
         std::stringstream ss;
         ss << "BestA: " << best_a << ", MaxScore: " << max_score << ", Info: " << edge_info.info();
@@ -11,8 +11,19 @@
 #include <vector>
 #include <functional>
 #include <mutex>
+#include <new>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
 
 #include "utils.h"
 #include "primitive.h"
@@ -66,6 +77,13 @@ protected:
     mutex lock_state_;
     unique_ptr<S> s_;
     atomic<int> s_state_;
+
+    // Take over the state of another node. Only called when no search is running.
+    void take_state(NodeBaseT<S> &other) {
+      s_ = std::move(other.s_);
+      s_state_ = other.s_state_.load();
+      other.s_state_ = NODE_NULL;
+    }
 };
 
 // Tree node.
@@ -77,14 +95,17 @@ public:
 
     enum VisitType { NODE_NOT_VISITED = 0, NODE_JUST_VISITED, NODE_ALREADY_VISITED };
 
-    NodeT(Node *parent) : parent_(parent), visited_(false), count_(0) { }
+    NodeT(Node *parent) : parent_(parent), visited_(false), pending_(false), in_table_(false), count_(0) { }
     NodeT(const Node&) = delete;
     Node &operator=(const Node&) = delete;
 
-    const unordered_map<A, EdgeInfo> &sa() const { return sa_; }
+    // Children sorted by prior, largest first.
+    const ChildrenT<A> &sa() const { return sa_; }
     int count() const { return count_; }
     float value() const { return V_; }
+    bool visited() const { return visited_; }
 
+    // func returns the evaluation of this node, or nullptr if it failed. Then the node stays unvisited.
     template <typename ExpandFunc, typename InitFunc>
     VisitType ExpandIfNecessary(ExpandFunc func, InitFunc init, NodeAlloc &alloc) {
         if (visited_) return NODE_ALREADY_VISITED;
@@ -93,60 +114,107 @@ public:
         lock_guard<mutex> lock(lock_node_);
         if (visited_) return NODE_ALREADY_VISITED;
 
-        auto resp = func(this);
+        const NodeResponseT<A> *resp = func(this);
+        if (resp == nullptr) return NODE_NOT_VISITED;
 
-        // Then we need to allocate sa_val_
-        for (const pair<A, float> & action_pair : resp.pi) {
-            auto res = sa_.insert(make_pair(action_pair.first, EdgeInfo(action_pair.second)));
-            res.first->second.next = alloc.Alloc(this);
-            init(res.first->second);
-            // Compute v here.
-            // Node *child = alloc[res.first->second.next];
-            // child->V_ = V_ + log(action_pair.second + 1e-6);
-        }
+        expand_no_lock(*resp, init, alloc);
+        return NODE_JUST_VISITED;
+    }
 
-        // value
-        V_ = resp.value;
+    // For batched evaluation. Only one caller gets true, and it is responsible for calling Expand later.
+    bool ClaimExpansion() {
+        if (visited_) return false;
+        return ! pending_.exchange(true);
+    }
 
-        // Once sa_ is allocated, its structure won't change.
-        visited_ = true;
+    // Undo ClaimExpansion() if the leaf could not be evaluated.
+    void ReleaseExpansion() { pending_ = false; }
+
+    template <typename InitFunc>
+    VisitType Expand(const NodeResponseT<A> &resp, InitFunc init, NodeAlloc &alloc) {
+        lock_guard<mutex> lock(lock_node_);
+        if (visited_) return NODE_ALREADY_VISITED;
+
+        expand_no_lock(resp, init, alloc);
         return NODE_JUST_VISITED;
     }
 
-    bool AccumulateStats(const A &a, float reward) {
-        auto res = elf_utils::map_get(sa_, a);
+    // Count a pending visit as a loss so that other threads prefer other paths.
+    // Use a negative virtual_loss to revert it.
+    bool AddVirtualLoss(int i, int virtual_loss) {
+        if (i < 0 || i >= (int)sa_.size()) return false;
+
+#ifndef MCTS_ATOMIC_EDGE
+        lock_guard<mutex> lock(lock_node_);
+#endif
+        sa_[i].second.Add(0, virtual_loss);
+        return true;
+    }
+
+    // virtual_loss is the amount added by AddVirtualLoss on the way down, which is reverted here.
+    bool AccumulateStats(int i, float reward, int virtual_loss = 0) {
         // Not found, skip
-        if (! res.second) return false;
+        if (i < 0 || i >= (int)sa_.size()) return false;
 
         // Inc #visited
         count_ ++;
 
-        EdgeInfo &info = res.first->second;
-        // Async modification (we probably need to add a locker in the future, or not for speed).
+        EdgeInfo &info = sa_[i].second;
+        // Async modification.
+#ifndef MCTS_ATOMIC_EDGE
         lock_guard<mutex> lock(lock_node_);
-        info.acc_reward += reward;
-        info.n ++;
+#endif
+        info.Add(reward, 1 - virtual_loss);
         return true;
     }
 
+    // Index of the child with action a, or -1.
+    int FindChild(const A &a) const {
+        for (size_t i = 0; i < sa_.size(); ++i) {
+            if (sa_[i].first == a) return i;
+        }
+        return -1;
+    }
+
     NodeId Descent(const A &a) const {
-        auto res = elf_utils::map_get(sa_, a);
-        if (! res.second) return NodeIdInvalid;
-        return res.first->second.next;
+        return DescentAt(FindChild(a));
+    }
+
+    NodeId DescentAt(int i) const {
+        if (i < 0 || i >= (int)sa_.size()) return NodeIdInvalid;
+        return sa_[i].second.next.load(std::memory_order_acquire);
+    }
+
+    // Point child i to another node with the same state, found in the transposition table.
+    void SetChild(int i, NodeId id) {
+        if (i < 0 || i >= (int)sa_.size()) return;
+        // Threads descending through this edge see either the old or the new node, both fully set up.
+        sa_[i].second.next.store(id, std::memory_order_release);
+    }
+
+    // Return true only for the first caller, who looks the node up in the transposition table.
+    bool MarkInTable() {
+        return ! in_table_.exchange(true);
     }
 
-    string _info(int indent, const NodeAlloc &alloc) const {
+    // With a transposition table a node can have several parents, so each subtree is only printed once.
+    string _info(int indent, const NodeAlloc &alloc, unordered_set<const Node *> *printed) const {
         std::stringstream ss;
         std::string indent_str;
         for (int i = 0; i < indent; ++i) indent_str += ' ';
 
         for (const auto & p : sa_) {
             if (p.second.n > 0) {
-                const Node *n = alloc[p.second.next];
+                const Node *n = alloc[p.second.next.load(std::memory_order_acquire)];
                 if (n->visited_) {
                     ss << indent_str << "[" << p.first << "] " << p.second.info();
-                    ss << ", V: " << n->V_ << endl;
-                    ss << n->_info(indent + 2, alloc);
+                    ss << ", V: " << n->V_;
+                    if (! printed->insert(n).second) {
+                        ss << " (transposition)" << endl;
+                        continue;
+                    }
+                    ss << endl;
+                    ss << n->_info(indent + 2, alloc, printed);
                 }
             }
         }
@@ -154,7 +222,51 @@ public:
     }
 
     string info(const NodeAlloc &alloc) const {
-        return _info(0, alloc);
+        unordered_set<const Node *> printed;
+        return _info(0, alloc, &printed);
+    }
+
+    // Mix Dirichlet(alpha) noise into the priors, at most once per node.
+    // Only called when no search is running.
+    template <typename Rng>
+    void AddPriorNoise(float epsilon, float alpha, Rng &rng) {
+        if (noise_added_ || sa_.empty()) return;
+
+        gamma_distribution<float> gamma(alpha, 1.0);
+        vector<float> noise(sa_.size());
+        float sum = 0.0;
+        for (float &v : noise) {
+            v = gamma(rng);
+            sum += v;
+        }
+        if (sum <= 0) return;
+
+        for (size_t i = 0; i < sa_.size(); ++i) {
+            float &prior = sa_[i].second.prior;
+            prior = (1 - epsilon) * prior + epsilon * noise[i] / sum;
+        }
+        std::stable_sort(sa_.begin(), sa_.end(), [](const pair<A, EdgeInfo> &e1, const pair<A, EdgeInfo> &e2) {
+            return e1.second.prior > e2.second.prior;
+        });
+        noise_added_ = true;
+    }
+
+    // Move the content of another node into this one, used when NodeAlloc compacts the tree.
+    // Only called when no search is running.
+    void MoveFrom(Node *other) {
+        this->take_state(*other);
+        visited_ = other->visited_.load();
+        noise_added_ = other->noise_added_;
+        sa_ = std::move(other->sa_);
+        count_ = other->count_.load();
+        V_ = other->V_;
+    }
+
+    template <typename RemapFunc>
+    void RemapChildren(RemapFunc func) {
+        for (auto &p : sa_) {
+            if (p.second.next != NodeIdInvalid) p.second.next = func(p.second.next, this);
+        }
     }
 
 private:
@@ -162,10 +274,162 @@ private:
     Node *parent_;
     mutex lock_node_;
     atomic_bool visited_;
-    unordered_map<A, EdgeInfo> sa_;
+    // Claimed by a thread for batched evaluation, but not expanded yet.
+    atomic_bool pending_;
+    // Already looked up in the transposition table.
+    atomic_bool in_table_;
+    bool noise_added_ = false;
+    ChildrenT<A> sa_;
 
     atomic<int> count_;
     float V_ = 0.0;
+
+    template <typename InitFunc>
+    void expand_no_lock(const NodeResponseT<A> &resp, InitFunc init, NodeAlloc &alloc) {
+        // Then we need to allocate sa_val_
+        sa_.reserve(resp.pi.size());
+        for (const pair<A, float> & action_pair : resp.pi) {
+            sa_.emplace_back(action_pair.first, EdgeInfo(action_pair.second));
+        }
+        std::stable_sort(sa_.begin(), sa_.end(), [](const pair<A, EdgeInfo> &e1, const pair<A, EdgeInfo> &e2) {
+            return e1.second.prior > e2.second.prior;
+        });
+
+        for (auto &p : sa_) {
+            p.second.next = alloc.Alloc(this);
+            init(p.second);
+            // Compute v here.
+            // Node *child = alloc[p.second.next];
+            // child->V_ = V_ + log(p.second.prior + 1e-6);
+        }
+
+        // value
+        V_ = resp.value;
+
+        // Once sa_ is allocated, its structure won't change.
+        visited_ = true;
+    }
+};
+
+// Nodes are placed in fixed-size chunks and addressed by NodeId = chunk * kChunkSize + offset.
+// Chunks are reached through a two-level table (directory -> chunk), both allocated on demand,
+// so the arena grows up to the NodeId range and a chunk never moves once allocated.
+// Looking up a node needs no lock.
+// Nodes are not freed one by one, Reset() destroys all of them at once and keeps the chunks for reuse.
+// When the ids or the memory run out, Alloc returns NodeIdInvalid and the search stops expanding
+// below that node. It never throws, since it runs on the search threads.
+template <typename Node>
+class NodeArenaT {
+public:
+    static constexpr int kChunkBits = 10;
+    static constexpr int kChunkSize = 1 << kChunkBits;
+    static constexpr int kDirBits = 10;
+    static constexpr int kDirSize = 1 << kDirBits;
+    static constexpr NodeId kMaxNodes = std::numeric_limits<NodeId>::max();
+    static constexpr int kMaxDirs = (int)(((int64_t)kMaxNodes >> (kChunkBits + kDirBits)) + 1);
+
+    NodeArenaT() : dirs_(new atomic<Dir *>[kMaxDirs]), size_(0), full_(false) {
+        for (int i = 0; i < kMaxDirs; ++i) dirs_[i] = nullptr;
+    }
+
+    NodeArenaT(const NodeArenaT&) = delete;
+    NodeArenaT &operator=(const NodeArenaT&) = delete;
+
+    ~NodeArenaT() {
+        Reset();
+        for (int i = 0; i < kMaxDirs; ++i) {
+            Dir *dir = dirs_[i].load();
+            if (dir == nullptr) continue;
+            for (int j = 0; j < kDirSize; ++j) delete [] dir->chunks[j].load();
+            delete dir;
+        }
+    }
+
+    NodeId size() const { return size_.load(); }
+
+    // Thread-safe. Only the allocation of a new chunk takes a lock.
+    template <typename... Args>
+    NodeId Alloc(Args&&... args) {
+        NodeId id = size_.load();
+        do {
+            if (full_.load() || id >= kMaxNodes) return NodeIdInvalid;
+        } while (! size_.compare_exchange_weak(id, id + 1));
+
+        Slot *chunk = get_chunk(id);
+        if (chunk == nullptr) chunk = alloc_chunk(id);
+        // Out of memory. The slot stays unconstructed, its chunk does not exist.
+        if (chunk == nullptr) return NodeIdInvalid;
+        new (&chunk[id & (kChunkSize - 1)]) Node(std::forward<Args>(args)...);
+        return id;
+    }
+
+    Node *operator[](NodeId id) const {
+        if (id < 0 || id >= size_.load(memory_order_acquire)) return nullptr;
+        Slot *chunk = get_chunk(id);
+        if (chunk == nullptr) return nullptr;
+        return reinterpret_cast<Node *>(&chunk[id & (kChunkSize - 1)]);
+    }
+
+    // Not thread-safe. Destroy all nodes in one pass.
+    // A slot is constructed iff its chunk exists, see alloc_chunk.
+    void Reset() {
+        const NodeId n = size_.load();
+        for (NodeId id = 0; id < n; ++id) {
+            Node *node = (*this)[id];
+            if (node != nullptr) node->~Node();
+        }
+        size_ = 0;
+        full_ = false;
+    }
+
+private:
+    using Slot = typename std::aligned_storage<sizeof(Node), alignof(Node)>::type;
+    struct Dir {
+        atomic<Slot *> chunks[kDirSize];
+    };
+
+    unique_ptr<atomic<Dir *>[]> dirs_;
+    atomic<NodeId> size_;
+    // Set when memory ran out, until the next Reset().
+    atomic_bool full_;
+    mutex chunk_mutex_;
+
+    Slot *get_chunk(NodeId id) const {
+        const int c = id >> kChunkBits;
+        Dir *dir = dirs_[c >> kDirBits].load(memory_order_acquire);
+        return dir == nullptr ? nullptr : dir->chunks[c & (kDirSize - 1)].load(memory_order_acquire);
+    }
+
+    // An existing chunk is always returned, so every id reserved in it gets constructed.
+    // Once an allocation failed, no new chunk is created until Reset().
+    Slot *alloc_chunk(NodeId id) {
+        const int c = id >> kChunkBits;
+        lock_guard<mutex> lock(chunk_mutex_);
+        atomic<Dir *> &dir_ptr = dirs_[c >> kDirBits];
+        Dir *dir = dir_ptr.load(memory_order_acquire);
+        if (dir != nullptr) {
+            Slot *chunk = dir->chunks[c & (kDirSize - 1)].load(memory_order_acquire);
+            if (chunk != nullptr) return chunk;
+        }
+        if (full_) return nullptr;
+
+        if (dir == nullptr) {
+            dir = new (std::nothrow) Dir;
+            if (dir == nullptr) return out_of_memory();
+            for (int j = 0; j < kDirSize; ++j) dir->chunks[j] = nullptr;
+            dir_ptr.store(dir, memory_order_release);
+        }
+        Slot *chunk = new (std::nothrow) Slot[kChunkSize];
+        if (chunk == nullptr) return out_of_memory();
+        dir->chunks[c & (kDirSize - 1)].store(chunk, memory_order_release);
+        return chunk;
+    }
+
+    Slot *out_of_memory() {
+        full_ = true;
+        cout << "NodeArena: out of memory with " << size_.load() << " nodes, stop expanding" << endl;
+        return nullptr;
+    }
 };
 
 template <typename S, typename A>
@@ -173,6 +437,7 @@ class NodeAllocT {
 public:
     using Node = NodeT<S, A>;
     using NodeAlloc = NodeAllocT<S, A>;
+    using NodeArena = NodeArenaT<Node>;
 
     NodeAllocT() { Clear(); }
 
@@ -180,70 +445,90 @@ public:
     NodeAlloc &operator=(const NodeAlloc&) = delete;
 
     void Clear() {
-        allocated_.clear();
-        allocated_node_count_ = 0;
+        active().Reset();
+        clear_table();
         root_id_ = Alloc();
     }
 
+    // Keep the subtree under action a and reclaim everything else.
+    // The subtree is copied into the spare arena, then the old arena is reset as a whole.
     void TreeAdvance(const A& a) {
-        NodeId next_root = NodeIdInvalid;
-        Node *r = root();
-
-        for (const auto &p : r->sa()) {
-            if (p.first == a) next_root = p.second.next;
-            else RecursiveFree(p.second.next);
-        }
-        // Free root.
-        Free(root_id_);
+        NodeId next_root = root()->Descent(a);
         if (next_root == NodeIdInvalid) {
-            root_id_ = Alloc();
-        } else {
-            root_id_ = next_root;
+            Clear();
+            return;
+        }
+
+        NodeArena &src = active();
+        NodeArena &dst = arenas_[1 - active_];
+        dst.Reset();
+
+        // Nodes shared through the transposition table are copied once.
+        vector<NodeId> new_ids(src.size(), NodeIdInvalid);
+        vector<pair<NodeId, Node *>> q;
+        root_id_ = dst.Alloc(nullptr);
+        new_ids[next_root] = root_id_;
+        q.push_back(make_pair(next_root, dst[root_id_]));
+
+        for (size_t i = 0; i < q.size(); ++i) {
+            Node *n = q[i].second;
+            n->MoveFrom(src[q[i].first]);
+            n->RemapChildren([&](NodeId old_id, Node *parent) {
+                if (new_ids[old_id] != NodeIdInvalid) return new_ids[old_id];
+                NodeId new_id = dst.Alloc(parent);
+                // Out of memory, the subtree below is dropped.
+                if (new_id == NodeIdInvalid) return new_id;
+                new_ids[old_id] = new_id;
+                q.push_back(make_pair(old_id, dst[new_id]));
+                return new_id;
+            });
         }
+
+        src.Reset();
+        active_ = 1 - active_;
+        // Node ids have changed. The table is filled again as the search visits the nodes.
+        clear_table();
+    }
+
+    // Return the node registered for hash. If there is none, id is registered and returned.
+    NodeId Transpose(uint64_t hash, NodeId id) {
+        TableShard &shard = table_[hash % kTableShards];
+        lock_guard<mutex> lock(shard.mutex_);
+        return shard.table_.emplace(hash, id).first->second;
     }
 
+    NodeId root_id() const { return root_id_; }
     Node *root() { return (*this)[root_id_]; }
     const Node *root() const { return (*this)[root_id_]; }
 
     // Low level functions.
     NodeId Alloc(Node *parent = nullptr) {
-        lock_guard<mutex> lock(alloc_mutex_);
-        allocated_[allocated_node_count_].reset(new Node(parent));
-        return allocated_node_count_ ++;
+        return active().Alloc(parent);
     }
 
-    void Free(NodeId id) {
-        allocated_.erase(id);
-    }
+    Node *operator[](NodeId i) { return active()[i]; }
+    const Node *operator[](NodeId i) const { return active()[i]; }
 
-    void RecursiveFree(NodeId id) {
-        Node *root = (*this)[id];
-        for (const auto &p : root->sa()) {
-            RecursiveFree(p.second.next);
-        }
-        Free(id);
-    }
+private:
+    // One arena holds the tree, the other is the target when TreeAdvance compacts it.
+    NodeArena arenas_[2];
+    int active_ = 0;
+    NodeId root_id_;
 
-    Node *operator[](NodeId i) {
-        lock_guard<mutex> lock(alloc_mutex_);
-        auto it = allocated_.find(i);
-        if (it == allocated_.end()) return nullptr;
-        else return it->second.get();
-    }
+    // Transposition table, sharded to reduce lock contention. Empty unless TSOptions::use_transposition_table.
+    static constexpr int kTableShards = 16;
+    struct TableShard {
+        mutex mutex_;
+        unordered_map<uint64_t, NodeId> table_;
+    };
+    TableShard table_[kTableShards];
 
-    const Node *operator[](NodeId i) const {
-        lock_guard<mutex> lock(alloc_mutex_);
-        auto it = allocated_.find(i);
-        if (it == allocated_.end()) return nullptr;
-        else return it->second.get();
+    void clear_table() {
+        for (auto &shard : table_) shard.table_.clear();
     }
 
-private:
-    // TODO: We might just allocate one chunk at a time.
-    unordered_map<NodeId, unique_ptr<Node>> allocated_;
-    NodeId allocated_node_count_;
-    mutable mutex alloc_mutex_;
-    NodeId root_id_;
+    NodeArena &active() { return arenas_[active_]; }
+    const NodeArena &active() const { return arenas_[active_]; }
 };
 
 
@@ -32,10 +32,37 @@ struct TSOptions {
     // string pick_method = "strongest_prior";
     string pick_method = "most_visited";
     bool use_prior = false;
+    float c_puct = 0.5;
+    // Value of an edge that has not been visited yet.
+    float first_play_urgency = 0.5;
+
+    // Dirichlet noise mixed into the root priors (AlphaZero style). 0 = no noise.
+    float dirichlet_epsilon = 0.0;
+    float dirichlet_alpha = 0.03;
+    // Seed of the root noise, set per game. 0 = seed from std::random_device.
+    int seed = 0;
+
+    // Search budgets. The search stops at whichever limit is hit first.
+    // Wall-clock limit per move in ms, 0 = no limit.
+    int time_budget_ms = 0;
+    // #rollouts shared by all threads, replaces num_rollout_per_thread if > 0.
+    int num_rollouts = 0;
 
     // Pre-added pseudo playout.
     int pseudo_games = 0;
 
+    // Visits added to an edge while a rollout through it is pending, so concurrent rollouts spread out.
+    int virtual_loss = 0;
+
+    // Share one node between equivalent states reached by different paths. Needs S::GetHash().
+    bool use_transposition_table = false;
+
+    // #leaves each thread collects before evaluating them in one call. Virtual loss is at least 1 if > 1.
+    int leaf_batch_size = 1;
+    // A leaf already pending in another path is a collision. It does not use a rollout, but a thread
+    // stops its search after this many of them in a row without a backprop. 0 = no limit.
+    int max_leaf_collisions = 1000;
+
     string info() const {
       stringstream ss;
       ss << "Maximal #moves (0 = no constraint): " << max_num_moves << endl;
@@ -44,14 +71,23 @@ struct TSOptions {
       ss << "Verbose: " << elf_utils::print_bool(verbose) << ", Verbose_time: " << elf_utils::print_bool(verbose_time) << endl;
       if (! save_tree_filename.empty())
         ss << "Save tree filename: " << save_tree_filename << endl;
-      ss << "Use prior: " << elf_utils::print_bool(use_prior) << endl;
+      ss << "Use prior: " << elf_utils::print_bool(use_prior) << ", c_puct: " << c_puct << ", First play urgency: " << first_play_urgency << endl;
+      if (dirichlet_epsilon > 0)
+        ss << "Root Dirichlet noise: epsilon " << dirichlet_epsilon << ", alpha " << dirichlet_alpha << ", seed " << seed << endl;
+      if (time_budget_ms > 0)
+        ss << "Time budget: " << time_budget_ms << "ms" << endl;
+      if (num_rollouts > 0)
+        ss << "#Rollouts (all threads): " << num_rollouts << endl;
       ss << "Persistent tree: " << elf_utils::print_bool(persistent_tree) << endl;
       ss << "#Pseudo game: " << pseudo_games << endl;
+      ss << "Virtual loss: " << virtual_loss << endl;
+      ss << "Leaf batch size: " << leaf_batch_size << ", max leaf collisions: " << max_leaf_collisions << endl;
+      ss << "Transposition table: " << elf_utils::print_bool(use_transposition_table) << endl;
       ss << "Pick method: " << pick_method << endl;
       return ss.str();
     }
 
-    REGISTER_PYBIND_FIELDS(max_num_moves, num_threads, num_rollout_per_thread, verbose, persistent_tree, pick_method, use_prior, pseudo_games, verbose_time, save_tree_filename);
+    REGISTER_PYBIND_FIELDS(max_num_moves, num_threads, num_rollout_per_thread, verbose, persistent_tree, pick_method, use_prior, pseudo_games, verbose_time, save_tree_filename, virtual_loss, leaf_batch_size, max_leaf_collisions, c_puct, first_play_urgency, dirichlet_epsilon, dirichlet_alpha, seed, time_budget_ms, num_rollouts, use_transposition_table);
 };
 
 } // namespace mcts
@@ -17,14 +17,18 @@ class Batch:
         "int64_t" : torch.LongTensor,
         "float" : torch.FloatTensor,
         "unsigned char" : torch.ByteTensor,
-        "char" : torch.ByteTensor
+        "char" : torch.ByteTensor,
+        "int8_t" : torch.CharTensor,
+        "float16" : torch.HalfTensor
     }
     numpy_types = {
         "int32_t": 'i4',
         'int64_t': 'i8',
         'float': 'f4',
         'unsigned char': 'byte',
-        'char': 'byte'
+        'char': 'byte',
+        'int8_t': 'i1',
+        'float16': 'f2'
     }
 
     def __init__(self, _batchsize=None, **kwargs):
@@ -67,7 +71,7 @@ class Batch:
         return v, info
 
     @staticmethod
-    def load(GC, input_reply, desc, group_id, use_gpu=True, use_numpy=False):
+    def load(GC, input_reply, desc, group_id, use_gpu=True, use_numpy=False, buf_id=0):
         '''load Batch from the specifications
 
         Args:
@@ -77,6 +81,7 @@ class Batch:
             group_id(int): group id. Batch data with the same group id will be batched together
             use_gpu(bool): indicates if we use gpu
             use_numpy(bool): indicates if we use numpy
+            buf_id(int): which buffer set of the group the batch is for, see ``ContextOptions.num_buffers``
 
         Returns:
             loaded batch object
@@ -94,7 +99,7 @@ class Batch:
             batch.batch[info.key] = v
             batch.dims[info.key] = info
             # print(key + " : " + str(v.size()))
-            GC.AddTensor(group_id, input_reply, info)
+            GC.AddTensor(group_id, input_reply, info, buf_id)
 
         return batch
 
@@ -246,6 +251,10 @@ class GCWrapper:
 
         inputs = []
         replies = []
+        # All buffer sets of each group, inputs/replies are the first ones.
+        input_buffers = []
+        reply_buffers = []
+        num_buffers = max(co.num_buffers, 1)
         idx2name = {}
         name2idx = defaultdict(list)
 
@@ -269,15 +278,20 @@ class GCWrapper:
             for i in range(num_recv_thread):
                 group_id = GC.AddCollectors(batchsize, len(gpu2gid) - 1, timeout_usec, gstat)
 
-                input_batch = Batch.load(GC, "input", input, group_id, use_gpu=use_gpu, use_numpy=use_numpy)
-                input_batch.batchsize = batchsize
-                inputs.append(input_batch)
-                if reply is not None:
-                    reply_batch = Batch.load(GC, "reply", reply, group_id, use_gpu=use_gpu, use_numpy=use_numpy)
-                    reply_batch.batchsize= batchsize
-                    replies.append(reply_batch)
-                else:
-                    replies.append(None)
+                input_buffers.append([])
+                reply_buffers.append([])
+                for b in range(num_buffers):
+                    input_batch = Batch.load(GC, "input", input, group_id, use_gpu=use_gpu, use_numpy=use_numpy, buf_id=b)
+                    input_batch.batchsize = batchsize
+                    input_buffers[-1].append(input_batch)
+                    if reply is not None:
+                        reply_batch = Batch.load(GC, "reply", reply, group_id, use_gpu=use_gpu, use_numpy=use_numpy, buf_id=b)
+                        reply_batch.batchsize= batchsize
+                        reply_buffers[-1].append(reply_batch)
+                    else:
+                        reply_buffers[-1].append(None)
+                inputs.append(input_buffers[-1][0])
+                replies.append(reply_buffers[-1][0])
 
                 idx2name[group_id] = key
                 name2idx[key].append(group_id)
@@ -287,13 +301,16 @@ class GCWrapper:
         print(GC.GetCollectorInfos())
 
         # Zero out all replies.
-        for reply in replies:
-            if reply is not None:
-                reply.setzero()
+        for buffers in reply_buffers:
+            for reply in buffers:
+                if reply is not None:
+                    reply.setzero()
 
         self.GC = GC
         self.inputs = inputs
         self.replies = replies
+        self.input_buffers = input_buffers
+        self.reply_buffers = reply_buffers
         self.idx2name = idx2name
         self.name2idx = name2idx
         self.gid2gpu = gid2gpu
@@ -336,7 +353,7 @@ class GCWrapper:
 
         batchsize = len(infos.s)
 
-        sel = self.inputs[infos.gid].first_k(batchsize)
+        sel = self.input_buffers[infos.gid][infos.buf_id].first_k(batchsize)
         if self.inputs_gpu is not None:
             sel_gpu = self.inputs_gpu[self.gid2gpu[infos.gid]].first_k(batchsize)
             sel.transfer_cpu2gpu(sel_gpu)
@@ -351,8 +368,8 @@ class GCWrapper:
         picked.max_batchsize = self.inputs[infos.gid].batchsize
 
         # Get the reply array
-        if len(self.replies) > infos.gid and self.replies[infos.gid] is not None:
-            sel_reply = self.replies[infos.gid].first_k(batchsize)
+        if len(self.reply_buffers) > infos.gid and self.reply_buffers[infos.gid][infos.buf_id] is not None:
+            sel_reply = self.reply_buffers[infos.gid][infos.buf_id].first_k(batchsize)
         else:
             sel_reply = None
 
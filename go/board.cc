@@ -13,6 +13,57 @@
 #define min(a, b) ( ((a) < (b)) ? (a) : (b) )
 #define max(a, b) ( ((a) > (b)) ? (a) : (b) )
 
+// Zobrist keys. Generated from a fixed seed so hashes are the same across runs and processes.
+struct ZobristTable {
+  uint64_t stones[BOUND_COORD][2];
+  uint64_t ko[BOUND_COORD];
+  uint64_t white_to_play;
+
+  ZobristTable() {
+    // splitmix64
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    auto next = [&seed]() {
+      uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      return z ^ (z >> 31);
+    };
+    for (int c = 0; c < BOUND_COORD; ++c) {
+      stones[c][0] = next();
+      stones[c][1] = next();
+      ko[c] = next();
+    }
+    white_to_play = next();
+  }
+};
+
+static const ZobristTable &zobrist() {
+  static ZobristTable table;
+  return table;
+}
+
+uint64_t GetStoneHash(Coord c, Stone player) {
+  return zobrist().stones[c][player - S_BLACK];
+}
+
+uint64_t GetPositionHash(const Board *board) {
+  uint64_t h = board->_hash;
+  if (board->_next_player == S_WHITE) h ^= zobrist().white_to_play;
+  if (board->_ko_age == 0 && board->_simple_ko != M_PASS && board->_simple_ko_color == board->_next_player) h ^= zobrist().ko[board->_simple_ko];
+  return h;
+}
+
+uint64_t ComputeStoneHash(const Board *board) {
+  uint64_t h = 0;
+  for (int i = 0; i < BOARD_SIZE; ++i) {
+    for (int j = 0; j < BOARD_SIZE; ++j) {
+      Coord c = OFFSETXY(i, j);
+      if (HAS_STONE(board->_infos[c].color)) h ^= GetStoneHash(c, board->_infos[c].color);
+    }
+  }
+  return h;
+}
+
 // Functions..
 void SetAsBorder(Board* board, int /*side*/, int i1, int w, int j1, int h) {
   for (int i = i1; i < i1 + w; i++) {
@@ -43,6 +94,11 @@ void ClearBoard(Board *board) {
   // The initial ply number is 1.
   board->_ply = 1;
   // The initial hash is zero.
+  for (int i = 0; i < BOARD_SIZE; ++i) {
+    for (int j = 0; j < BOARD_SIZE; ++j) {
+      BITBOARD_SET(&board->_bits[S_EMPTY], OFFSETXY(i, j));
+    }
+  }
 }
 
 bool PlaceHandicap(Board *board, int x, int y, Stone player) {
@@ -70,6 +126,9 @@ void CopyBoard(Board *dst, const Board* src) {
 }
 
 bool CompareBoard(const Board *b1, const Board *b2) {
+  // Different stones, no need to look further.
+  if (b1->_hash != b2->_hash) return false;
+
   // Compare them per byte.
   unsigned char *p1 = (unsigned char *)b1;
   unsigned char *p2 = (unsigned char *)b2;
@@ -164,6 +223,19 @@ bool IsSelfAtariXY(const Board *board, const GroupId4 *ids, int x, int y, Stone
   return IsSelfAtari(board, ids, OFFSETXY(x, y), player, num_stones);
 }
 
+// Add cc to the liberties of the group formed at c, if it is empty or captured by the move.
+// Return false once there are two different liberties.
+static inline bool CountLiberty(const Board *board, Coord c, Coord cc, const unsigned short *captured, int num_captured, Coord libs[2], int *num_libs) {
+  if (cc == c) return true;
+  unsigned short id = board->_infos[cc].id;
+  bool is_liberty = G_EMPTY(id);
+  for (int i = 0; i < num_captured; ++i) is_liberty |= (id == captured[i]);
+  if (! is_liberty) return true;
+  if (*num_libs == 1 && libs[0] == cc) return true;
+  libs[(*num_libs) ++] = cc;
+  return *num_libs < 2;
+}
+
 // If num_stones is not NULL, return the number of stones for the to-be-formed atari group.
 bool IsSelfAtari(const Board *board, const GroupId4 *ids, Coord c, Stone player, int *num_stones) {
   if (board == NULL) error("SelfAtari: board cannot be NULL!\n");
@@ -184,15 +256,33 @@ bool IsSelfAtari(const Board *board, const GroupId4 *ids, Coord c, Stone player,
     }
   }
 
-  // Then we duplicate a board and check.
-  Board b2;
-  CopyBoard(&b2, board);
-  Play(&b2, ids);
-  // ShowBoard(&b2, SHOW_LAST_MOVE);
+  // Count the liberties of the group formed at c without playing the move.
+  // Enemy neighbors with one liberty are captured, and their stones become liberties.
+  unsigned short captured[4];
+  int num_captured = 0;
+  int stones = 1;
+  for (int i = 0; i < 4; ++i) {
+    if (ids->ids[i] == 0) continue;
+    if (ids->colors[i] == player) stones += board->_groups[ids->ids[i]].stones;
+    else if (ids->group_liberties[i] == 1) captured[num_captured ++] = ids->ids[i];
+  }
+
+  Coord libs[2] = { 0, 0 };
+  int num_libs = 0;
+  FOR4(c, _, cc) {
+    if (! CountLiberty(board, c, cc, captured, num_captured, libs, &num_libs)) return false;
+  } ENDFOR4
+  for (int i = 0; i < 4; ++i) {
+    if (ids->ids[i] == 0 || ids->colors[i] != player) continue;
+    TRAVERSE(board, ids->ids[i], s) {
+      FOR4(s, _, cc) {
+        if (! CountLiberty(board, c, cc, captured, num_captured, libs, &num_libs)) return false;
+      } ENDFOR4
+    } ENDTRAVERSE
+  }
 
-  short id = b2._infos[c].id;
-  if (b2._groups[id].liberties == 1) {
-    if (num_stones != NULL) *num_stones = b2._groups[id].stones;
+  if (num_libs == 1) {
+    if (num_stones != NULL) *num_stones = stones;
     return true;
   } else {
     return false;
@@ -200,7 +290,7 @@ bool IsSelfAtari(const Board *board, const GroupId4 *ids, Coord c, Stone player,
 }
 
 #define MAX_LADDER_SEARCH 1024
-int CheckLadderUseSearch(Board *board, Stone victim, int *num_call, int depth) {
+int CheckLadderUseSearch(Board *board, Stone victim, int *num_call, int depth, BoardUndo *undo) {
   (*num_call) ++;
   Coord c = board->_last_move;
   Coord c2 = board->_last_move2;
@@ -250,11 +340,13 @@ int CheckLadderUseSearch(Board *board, Stone victim, int *num_call, int depth) {
       must_block = escape[0];
     }
 
+    // Every move is taken back before returning, so the caller sees the board unchanged.
     if (must_block != M_PASS) {
       // It suffices to only play must_block.
       if (TryPlay2(board, must_block, &ids)) {
-        Play(board, &ids);
-        int final_depth = CheckLadderUseSearch(board, victim, num_call, depth + 1);
+        PlayWithUndo(board, &ids, undo);
+        int final_depth = CheckLadderUseSearch(board, victim, num_call, depth + 1, undo);
+        UndoPlay(board, undo);
         if (final_depth > 0) return final_depth;
       }
     } else {
@@ -264,18 +356,13 @@ int CheckLadderUseSearch(Board *board, Stone victim, int *num_call, int depth) {
       // ShowBoard(board, SHOW_ALL);
 
       // We need to play both. This should seldomly happen.
-      Board b_next;
-      CopyBoard(&b_next, board);
-      if (TryPlay2(&b_next, escape[0], &ids)) {
-        Play(&b_next, &ids);
-        int final_depth = CheckLadderUseSearch(&b_next, victim, num_call, depth + 1);
-        if (final_depth > 0) return final_depth;
-      }
-
-      if (TryPlay2(board, escape[1], &ids)) {
-        Play(board, &ids);
-        int final_depth = CheckLadderUseSearch(board, victim, num_call, depth + 1);
-        if (final_depth > 0) return final_depth;
+      for (int i = 0; i < 2; ++i) {
+        if (TryPlay2(board, escape[i], &ids)) {
+          PlayWithUndo(board, &ids, undo);
+          int final_depth = CheckLadderUseSearch(board, victim, num_call, depth + 1, undo);
+          UndoPlay(board, undo);
+          if (final_depth > 0) return final_depth;
+        }
       }
     }
   } else {
@@ -297,19 +384,20 @@ int CheckLadderUseSearch(Board *board, Stone victim, int *num_call, int depth) {
       return 0;
     }
     if (TryPlay2(board, flee_loc, &ids)) {
-      Play(board, &ids);
+      PlayWithUndo(board, &ids, undo);
       unsigned char id = board->_infos[flee_loc].id;
-      if (board->_groups[id].liberties >= 3) return 0;
+      bool escaped = board->_groups[id].liberties >= 3;
       if (board->_groups[id].liberties == 2) {
         // Check if the neighboring enemy stone has only one liberty, if so, then it is not a ladder.
         FOR4(flee_loc, _, cc) {
           if (board->_infos[cc].color != OPPONENT(victim)) continue;
           unsigned char id2 = board->_infos[cc].id;
           // If the enemy group is in atari but our group has 2 liberties, then it is not a ladder.
-          if (board->_groups[id2].liberties == 1) return 0;
+          if (board->_groups[id2].liberties == 1) escaped = true;
         } ENDFOR4
       }
-      int final_depth = CheckLadderUseSearch(board, victim, num_call, depth + 1);
+      int final_depth = escaped ? 0 : CheckLadderUseSearch(board, victim, num_call, depth + 1, undo);
+      UndoPlay(board, undo);
       if (final_depth > 0) return final_depth;
     }
   }
@@ -385,7 +473,9 @@ int CheckLadder(const Board *board, const GroupId4 *ids, Stone player) {
     // Check whether it will lead to ladder.
     int num_call = 0;
     int depth = 1;
-    return CheckLadderUseSearch(&b_next, player, &num_call, depth);
+    // The journal is empty again after each search, so its buffers are kept for the next one.
+    static thread_local BoardUndo undo;
+    return CheckLadderUseSearch(&b_next, player, &num_call, depth, &undo);
   }
   return 0;
 }
@@ -403,6 +493,9 @@ void RemoveStoneAndAddLiberty(Board *board, Coord c) {
   }
 
   // printf("RemoveStoneAndAddLiberty: Remove stone at (%d, %d), belonging to Group %d\n", X(c), Y(c), board->_infos[c].id);
+  board->_hash ^= GetStoneHash(c, board->_infos[c].color);
+  BITBOARD_CLEAR(&board->_bits[board->_infos[c].color], c);
+  BITBOARD_SET(&board->_bits[S_EMPTY], c);
   board->_infos[c].color = S_EMPTY;
   board->_infos[c].id = 0;
   board->_infos[c].next = 0;
@@ -682,36 +775,80 @@ void GetAllStones(const Board *board, AllMoves *black, AllMoves *white) {
   }
 }
 
+// out = in shifted towards higher coords by k (0 < k < 64).
+static inline void ShiftUp(const Bitboard *in, int k, Bitboard *out) {
+  for (int i = BITBOARD_WORDS - 1; i > 0; --i) {
+    out->bits[i] = (in->bits[i] << k) | (in->bits[i - 1] >> (64 - k));
+  }
+  out->bits[0] = in->bits[0] << k;
+}
+
+// out = in shifted towards lower coords by k (0 < k < 64).
+static inline void ShiftDown(const Bitboard *in, int k, Bitboard *out) {
+  for (int i = 0; i < BITBOARD_WORDS - 1; ++i) {
+    out->bits[i] = (in->bits[i] >> k) | (in->bits[i + 1] << (64 - k));
+  }
+  out->bits[BITBOARD_WORDS - 1] = in->bits[BITBOARD_WORDS - 1] >> k;
+}
+
+// Loop through the coords set in a bitboard, in increasing order.
+#define FOR_BITS(bb, c) \
+  for (int w_ = 0; w_ < BITBOARD_WORDS; ++w_) { \
+    for (uint64_t b_ = (bb)->bits[w_]; b_ != 0; b_ &= b_ - 1) { \
+      Coord c = (w_ << 6) + __builtin_ctzll(b_); \
+
+#define ENDFOR_BITS } }
+
+void GetLegalMoves(const Board *board, Stone player, Bitboard *legal) {
+  const Bitboard *empty = &board->_bits[S_EMPTY];
+  Bitboard shifted[4];
+  ShiftUp(empty, 1, &shifted[0]);
+  ShiftDown(empty, 1, &shifted[1]);
+  ShiftUp(empty, BOARD_EXPAND_SIZE, &shifted[2]);
+  ShiftDown(empty, BOARD_EXPAND_SIZE, &shifted[3]);
+
+  // An empty point with an empty neighbor is never a suicide.
+  Bitboard surrounded;
+  for (int i = 0; i < BITBOARD_WORDS; ++i) {
+    uint64_t has_liberty = shifted[0].bits[i] | shifted[1].bits[i] | shifted[2].bits[i] | shifted[3].bits[i];
+    legal->bits[i] = empty->bits[i] & has_liberty;
+    surrounded.bits[i] = empty->bits[i] & ~has_liberty;
+  }
+
+  // The others depend on the liberties of their neighboring groups.
+  GroupId4 ids;
+  FOR_BITS(&surrounded, c) {
+    StoneLibertyAnalysis(board, player, c, &ids);
+    if (! IsSuicideMove(&ids)) BITBOARD_SET(legal, c);
+  } ENDFOR_BITS
+
+  if (board->_ko_age == 0 && board->_simple_ko_color == player && board->_simple_ko != M_PASS) {
+    BITBOARD_CLEAR(legal, board->_simple_ko);
+  }
+}
+
 void FindAllCandidateMoves(const Board* board, Stone player, int self_atari_thres, AllMoves *all_moves) {
   GroupId4 ids;
-  Coord c;
   all_moves->board = board;
   all_moves->num_moves = 0;
   int self_atari_count = 0;
-  for (int x = 0; x < BOARD_SIZE; ++x) {
-    for (int y = 0; y < BOARD_SIZE; ++y) {
-      c = OFFSETXY(x, y);
-      if (!EMPTY(board->_infos[c].color)) continue;
-      StoneLibertyAnalysis(board, player, c, &ids);
-
-      // It is illegal to play at ko locations.
-      if (IsSimpleKoViolation(board, c, player)) continue;
 
-      // It is illegal to play a suicide move.
-      if (IsSuicideMove(&ids)) continue;
-
-      // Never fill a true eye.
-      if (IsTrueEye(board, c, player)) continue;
-
-      // Be careful about self-atari moves.
-      if (IsSelfAtari(board, &ids, c, player, &self_atari_count)) {
-        // For self-atari's with fewer counts, we could tolorate since they are usually important in killing others' group.
-        if (self_atari_count >= self_atari_thres) continue;
-      }
-
-      all_moves->moves[all_moves->num_moves++] = c;
+  // Ko violations and suicide moves are already excluded.
+  Bitboard legal;
+  GetLegalMoves(board, player, &legal);
+  FOR_BITS(&legal, c) {
+    // Never fill a true eye.
+    if (IsTrueEye(board, c, player)) continue;
+
+    // Be careful about self-atari moves.
+    StoneLibertyAnalysis(board, player, c, &ids);
+    if (IsSelfAtari(board, &ids, c, player, &self_atari_count)) {
+      // For self-atari's with fewer counts, we could tolorate since they are usually important in killing others' group.
+      if (self_atari_count >= self_atari_thres) continue;
     }
-  }
+
+    all_moves->moves[all_moves->num_moves++] = c;
+  } ENDFOR_BITS
 }
 
 void FindAllCandidateMovesInRegion(const Board* board, const Region *r, Stone player, int self_atari_thres, AllMoves *all_moves) {
@@ -734,18 +871,16 @@ void FindAllCandidateMovesInRegion(const Board* board, const Region *r, Stone pl
     bottom = r->bottom;
   }
 
+  // Ko violations and suicide moves are excluded here.
+  Bitboard legal;
+  GetLegalMoves(board, player, &legal);
+
   for (int x = left; x < right; ++x) {
     for (int y = top; y < bottom; ++y) {
       c = OFFSETXY(x, y);
-      if (!EMPTY(board->_infos[c].color)) continue;
+      if (! BITBOARD_HAS(&legal, c)) continue;
       StoneLibertyAnalysis(board, player, c, &ids);
 
-      // It is illegal to play at ko locations.
-      if (IsSimpleKoViolation(board, c, player)) continue;
-
-      // It is illegal to play a suicide move.
-      if (IsSuicideMove(&ids)) continue;
-
       // Never fill a true eye.
       if (IsTrueEye(board, c, player)) continue;
 
@@ -761,21 +896,13 @@ void FindAllCandidateMovesInRegion(const Board* board, const Region *r, Stone pl
 }
 
 void FindAllValidMoves(const Board* board, Stone player, AllMoves *all_moves) {
-  GroupId4 ids;
-  Coord c;
   all_moves->board = board;
   all_moves->num_moves = 0;
-  for (int x = 0; x < BOARD_SIZE; ++x) {
-    for (int y = 0; y < BOARD_SIZE; ++y) {
-      c = OFFSETXY(x, y);
-      if (!EMPTY(board->_infos[c].color)) continue;
-      StoneLibertyAnalysis(board, player, c, &ids);
-      if (IsSimpleKoViolation(board, c, player)) continue;
-      if (IsSuicideMove(&ids)) continue;
-
-      all_moves->moves[all_moves->num_moves++] = c;
-    }
-  }
+  Bitboard legal;
+  GetLegalMoves(board, player, &legal);
+  FOR_BITS(&legal, c) {
+    all_moves->moves[all_moves->num_moves++] = c;
+  } ENDFOR_BITS
 }
 
 void FindAllValidMovesInRegion(const Board *board, const Region *r, AllMoves *all_moves) {
@@ -1158,6 +1285,9 @@ bool Play(Board *board, const GroupId4 *ids) {
 
     new_id = CreateNewGroup(board, c, liberty);
   }
+  board->_hash ^= GetStoneHash(c, player);
+  BITBOARD_CLEAR(&board->_bits[S_EMPTY], c);
+  BITBOARD_SET(&board->_bits[player], c);
 
   // Check simple ko conditions.
   const Group* g = &board->_groups[new_id];
@@ -1175,9 +1305,102 @@ bool Play(Board *board, const GroupId4 *ids) {
 
   // Finally add the counter.
   update_next_move(board, c, player);
+
+#ifdef GO_CHECK_BOARD
+  // CompareBoard and the MCTS transposition table trust the incremental hash.
+  if (board->_hash != ComputeStoneHash(board)) error("Play: incremental hash %" PRIx64 " != recomputed %" PRIx64, board->_hash, ComputeStoneHash(board));
+#endif
   return false;
 }
 
+static inline void SaveGroupStones(const Board *board, unsigned short id, BoardUndo *undo) {
+  TRAVERSE(board, id, c) {
+    undo->coords.push_back(c);
+    undo->infos.push_back(board->_infos[c]);
+  } ENDTRAVERSE
+}
+
+// Save the entry of group id, once per move (the move's entries start at begin).
+static inline void SaveGroup(const Board *board, unsigned short id, BoardUndo *undo, size_t begin) {
+  for (size_t i = begin; i < undo->group_ids.size(); ++i) {
+    if (undo->group_ids[i] == id) return;
+  }
+  undo->group_ids.push_back(id);
+  undo->groups.push_back(board->_groups[id]);
+}
+
+bool PlayWithUndo(Board *board, const GroupId4 *ids, BoardUndo *undo) {
+  assert(undo, "PlayWithUndo: undo is nil!");
+  undo->moves.emplace_back();
+  BoardUndo::Move &move = undo->moves.back();
+  memcpy(move.tail, (unsigned char *)board + offsetof(Board, _num_groups), sizeof(move.tail));
+  const size_t group_begin = undo->group_ids.size();
+  const size_t info_begin = undo->coords.size();
+
+  Coord c = ids->c;
+  if (c != M_PASS && c != M_RESIGN) {
+    undo->coords.push_back(c);
+    undo->infos.push_back(board->_infos[c]);
+
+    // Neighboring groups can be merged or captured. At most 4 groups are removed per move,
+    // so only the last 4 groups can be moved to a new id.
+    unsigned short saved[8];
+    int num_saved = 0;
+    for (int i = 0; i < 4; ++i) {
+      if (ids->ids[i] != 0) saved[num_saved ++] = ids->ids[i];
+    }
+    for (int id = board->_num_groups - 4; id < board->_num_groups; ++id) {
+      if (id < 1) continue;
+      bool visited_before = false;
+      for (int j = 0; j < num_saved; ++j) visited_before |= (saved[j] == id);
+      if (! visited_before) saved[num_saved ++] = id;
+    }
+    for (int i = 0; i < num_saved; ++i) {
+      SaveGroupStones(board, saved[i], undo);
+      SaveGroup(board, saved[i], undo, group_begin);
+    }
+
+    // Groups next to captured stones gain liberties.
+    for (int i = 0; i < 4; ++i) {
+      unsigned short id = ids->ids[i];
+      if (id == 0 || ids->colors[i] == ids->player || board->_groups[id].liberties != 1) continue;
+      TRAVERSE(board, id, s) {
+        FOR4(s, _, cc) {
+          unsigned short id2 = board->_infos[cc].id;
+          if (G_HAS_STONE(id2)) SaveGroup(board, id2, undo, group_begin);
+        } ENDFOR4
+      } ENDTRAVERSE
+    }
+    // The slot where a new group would be created.
+    if (board->_num_groups < MAX_GROUP) SaveGroup(board, board->_num_groups, undo, group_begin);
+  }
+
+  move.num_groups = undo->group_ids.size() - group_begin;
+  move.num_infos = undo->coords.size() - info_begin;
+  return Play(board, ids);
+}
+
+void UndoPlay(Board *board, BoardUndo *undo) {
+  assert(undo, "UndoPlay: undo is nil!");
+  if (undo->moves.empty()) return;
+  const BoardUndo::Move &move = undo->moves.back();
+  const size_t info_begin = undo->coords.size() - move.num_infos;
+  for (size_t i = info_begin; i < undo->coords.size(); ++i) {
+    board->_infos[undo->coords[i]] = undo->infos[i];
+  }
+  const size_t group_begin = undo->group_ids.size() - move.num_groups;
+  for (size_t i = group_begin; i < undo->group_ids.size(); ++i) {
+    board->_groups[undo->group_ids[i]] = undo->groups[i];
+  }
+  memcpy((unsigned char *)board + offsetof(Board, _num_groups), move.tail, sizeof(move.tail));
+
+  undo->coords.resize(info_begin);
+  undo->infos.resize(info_begin);
+  undo->group_ids.resize(group_begin);
+  undo->groups.resize(group_begin);
+  undo->moves.pop_back();
+}
+
 bool UndoPass(Board *board) {
   if (board->_last_move != M_PASS) return false;
   update_undo(board);
@@ -1420,6 +1643,11 @@ void VerifyBoard(Board* board) {
       if (HAS_STONE(board->_infos[c].color)) {
         group_size[info->id] ++;
       }
+      for (Stone s = S_EMPTY; s <= S_WHITE; ++s) {
+        if ((board->_infos[c].color == s) != BITBOARD_HAS(&board->_bits[s], c)) {
+          printf("[VerifyError]: bitboard of color [%d] is wrong at (%d, %d)\n", s, X(c), Y(c));
+        }
+      }
     }
   }
 
@@ -1494,6 +1722,9 @@ void VerifyBoard(Board* board) {
     // Free the memory.
     delete [] visited;
   }
+  if (board->_hash != ComputeStoneHash(board)) {
+    printf("[VerifyError]: hash [%" PRIx64 "] != recomputed [%" PRIx64 "]\n", board->_hash, ComputeStoneHash(board));
+  }
   printf("-----End verifying-----\n");
 }
 
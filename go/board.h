@@ -9,18 +9,33 @@
 #pragma once
 
 #include <stdio.h>
+#include <stddef.h>
 #include <memory.h>
+#include <vector>
 #include "common.h"
 
-// This can be changed to 9x9
-constexpr int BOARD_SIZE = 19;
+// Board size is fixed at compile time. Build with -DGO_BOARD_SIZE=9 (or 13) for smaller boards,
+// so that all the arrays below shrink accordingly.
+#ifndef GO_BOARD_SIZE
+#define GO_BOARD_SIZE 19
+#endif
+constexpr int BOARD_SIZE = GO_BOARD_SIZE;
+static_assert(BOARD_SIZE == 9 || BOARD_SIZE == 13 || BOARD_SIZE == 19, "GO_BOARD_SIZE must be 9, 13 or 19");
 
 // 19x19 only
 #define STAR_ON19(i, j) ( ((i) == 3 || (i) == 9 || (i) == 15) && ((j) == 3 || (j) == 9 || (j) == 15) )
+// 13x13 only
+#define STAR_ON13(i, j) ( ( ((i) == 3 || (i) == 9) && ((j) == 3 || (j) == 9) ) || ((i) == 6 && (j) == 6) )
 // 9x9 only
-#define STAR_ON9(i, j) ( ( ((i) == 2 || (i) == 6) && ((j) == 2 || (j) == 6) ) || (i == 4 && j == 4) )
+#define STAR_ON9(i, j) ( ( ((i) == 2 || (i) == 6) && ((j) == 2 || (j) == 6) ) || ((i) == 4 && (j) == 4) )
 
+#if GO_BOARD_SIZE == 9
+#define STAR STAR_ON9
+#elif GO_BOARD_SIZE == 13
+#define STAR STAR_ON13
+#else
 #define STAR STAR_ON19
+#endif
 
 constexpr int BOARD_MARGIN = 1;
 constexpr int BOARD_EXPAND_SIZE = BOARD_SIZE + 2;
@@ -63,7 +78,7 @@ typedef struct {
 } GroupId4;
 
 // How many live groups can possibly be there in a game?
-// We use 173 so that sizeof(MBoard) <= 4096. This is important for atomic data transmission using pipe.
+// Group ids are stored in an unsigned char, so this has to stay below 256.
 #define MAX_GROUP 173
 /*
 Next step
@@ -74,6 +89,17 @@ Next step
 // Maximum possible value of coords.
 constexpr int BOUND_COORD = BOARD_EXPAND_SIZE * BOARD_EXPAND_SIZE;
 
+// One bit per Coord (the expanded layout, so the neighbors of c are c -/+ 1 and c -/+ BOARD_EXPAND_SIZE).
+// Off-board bits are never set.
+constexpr int BITBOARD_WORDS = (BOUND_COORD + 63) / 64;
+typedef struct {
+  uint64_t bits[BITBOARD_WORDS];
+} Bitboard;
+
+#define BITBOARD_HAS(bb, c) ( ((bb)->bits[(c) >> 6] >> ((c) & 63)) & 1 )
+#define BITBOARD_SET(bb, c) ( (bb)->bits[(c) >> 6] |= (1ULL << ((c) & 63)) )
+#define BITBOARD_CLEAR(bb, c) ( (bb)->bits[(c) >> 6] &= ~(1ULL << ((c) & 63)) )
+
 // Board
 typedef struct {
   // Board
@@ -81,6 +107,8 @@ typedef struct {
 
   // Group info
   Group _groups[MAX_GROUP];
+
+  // PlayWithUndo saves everything from here to the end as one block, so new fields have to go below.
   // Number of groups, including group 0 (empty intersection). So for empty board, _num_groups == 1.
   short _num_groups;
 
@@ -120,10 +148,37 @@ typedef struct {
   // The current ply number, it will be increase after each play.
   // The initial ply number is 1.
   short _ply;
-  // uint64_t hash for the current board situatons. If we want to enable it, then make MAX_GROUP smaller.
-  // uint64_t hash;
+  // Zobrist hash of the stones on the board (positional, without next player and ko).
+  // Updated incrementally in Play and on captures.
+  uint64_t _hash;
+  // Empty/black/white points, indexed by S_EMPTY, S_BLACK and S_WHITE. Kept in sync with _infos.
+  Bitboard _bits[3];
 } Board;
 
+// Journal of the moves played with PlayWithUndo, so that they can be taken back in place, last one first.
+// Per move it records the Group and Info entries the move may touch, and everything stored after _groups
+// (captures, last moves, ko state, next player, ply, hash and bitboards).
+// One journal serves a whole reading: its buffers grow to what the reading needs and are reused by every ply.
+struct BoardUndo {
+  struct Move {
+    unsigned char tail[sizeof(Board) - offsetof(Board, _num_groups)];
+    int num_groups;
+    int num_infos;
+  };
+  std::vector<Move> moves;
+  std::vector<unsigned short> group_ids;
+  std::vector<Group> groups;
+  std::vector<Coord> coords;
+  std::vector<Info> infos;
+};
+
+// Move::tail only covers the fields from _num_groups on. Everything before it must be _infos and _groups,
+// which PlayWithUndo journals entry by entry.
+static_assert(offsetof(Board, _infos) == 0, "Board must start with _infos");
+static_assert(offsetof(Board, _groups) == sizeof(Board::_infos), "Board::_groups must follow _infos");
+static_assert(offsetof(Board, _num_groups) == offsetof(Board, _groups) + sizeof(Board::_groups),
+              "Board::_num_groups must follow _groups");
+
 // Save all candidate moves.
 typedef struct {
   const Board *board;
@@ -243,6 +298,14 @@ extern inline Coord GetCoord(int x, int y) { return OFFSETXY(x, y); }
 void ClearBoard(Board *board);
 void CopyBoard(Board *dst, const Board* src);
 bool CompareBoard(const Board *b1, const Board *b2);
+
+// Zobrist key of a stone of player (S_BLACK/S_WHITE) at c.
+uint64_t GetStoneHash(Coord c, Stone player);
+// Hash of the stones, the next player and an active simple ko. Two boards with the same hash
+// (almost surely) have the same legal moves.
+uint64_t GetPositionHash(const Board *board);
+// Recompute board->_hash from scratch.
+uint64_t ComputeStoneHash(const Board *board);
 // Return true if the move is valid and can be played, if so, properly set up ids
 // Otherwise return false.
 bool TryPlay(const Board *board, int x, int y, Stone player, GroupId4 *ids);
@@ -252,6 +315,11 @@ bool TryPlay2(const Board *board, Coord m, GroupId4 *ids);
 // Actually play the game. If return true, then the game ended (either by PASS + PASS or by RESIGN)
 bool Play(Board *board, const GroupId4 *ids);
 
+// Same as Play, but push the move to undo so that UndoPlay can restore the board. Used for tactical reading.
+bool PlayWithUndo(Board *board, const GroupId4 *ids, BoardUndo *undo);
+// Take back the last move pushed to undo.
+void UndoPlay(Board *board, BoardUndo *undo);
+
 // Place handicap stone.
 bool PlaceHandicap(Board *board, int x, int y, Stone player);
 
@@ -269,7 +337,10 @@ bool IsIn(const Region *region, Coord c);
 void Expand(Region *region, Coord c);
 bool GroupInRegion(const Board *board, short group_idx, const Region *r);
 
-// Pretty slow. Need some improvements.
+// Set legal to all empty points where player can play, i.e. not a suicide and not a simple ko violation.
+// Points with an empty neighbor are handled with a few word-wide shifts, only the rest are analyzed one by one.
+void GetLegalMoves(const Board *board, Stone player, Bitboard *legal);
+
 // Find all valid moves excluding self-atari.
 void FindAllCandidateMoves(const Board* board, Stone player, int self_atari_thres, AllMoves *all_moves);
 void FindAllCandidateMovesInRegion(const Board* board, const Region *r, Stone player, int self_atari_thres, AllMoves *all_moves);
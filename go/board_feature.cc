@@ -11,17 +11,18 @@
 #include <cmath>
 using namespace std;
 
-#define S_ISA(c1, c2) ( (c2 == S_EMPTY) || (c1 == c2) )
 // For feature extraction.
 // Distance transform
 static void DistanceTransform(float* arr) {
 #define IND(i, j) ((i) * BOARD_SIZE + (j))
-  // First dimension.
-  for (int j = 0; j < BOARD_SIZE; j++) {
-    for (int i = 1; i < BOARD_SIZE; i++) {
+  // First dimension. Whole rows at a time so that the inner loop vectorizes.
+  for (int i = 1; i < BOARD_SIZE; i++) {
+    for (int j = 0; j < BOARD_SIZE; j++) {
       arr[IND(i, j)] = min(arr[IND(i, j)], arr[IND(i - 1, j)] + 1);
     }
-    for (int i = BOARD_SIZE - 2; i >= 0; i--) {
+  }
+  for (int i = BOARD_SIZE - 2; i >= 0; i--) {
+    for (int j = 0; j < BOARD_SIZE; j++) {
       arr[IND(i, j)] = min(arr[IND(i, j)], arr[IND(i + 1, j)] + 1);
     }
   }
@@ -37,134 +38,48 @@ static void DistanceTransform(float* arr) {
 #undef IDX
 }
 
-// If we set player = 0 (S_EMPTY), then the liberties of both side will be returned.
-bool BoardFeature::GetLibertyMap(Stone player, float* data) const {
-  // We assume the output liberties is a 19x19 tensor.
-  /*
-  if (THTensor_nDimension(liberties) != 2) return false;
-  if (THTensor_size(liberties, 1) != BOARD_SIZE) return false;
-  if (THTensor_size(liberties, 2) != BOARD_SIZE) return false;
-  float *data = THTensor_data(liberties);
-
-  int stride = THTensor_stride(liberties, 1);
-  */
-  memset(data, 0, BOARD_SIZE * BOARD_SIZE * sizeof(float));
-  for (int i = 1; i < _board->_num_groups; ++i) {
-    if (S_ISA(_board->_groups[i].color, player)) {
-      int liberty = _board->_groups[i].liberties;
-      TRAVERSE(_board, i, c) {
-        data[transform(c)] = liberty;
-      } ENDTRAVERSE
-    }
-  }
+namespace {
 
-  return true;
-}
+struct D4Tables {
+  short perm[8][BOUND_COORD];
 
-bool BoardFeature::GetLibertyMap3(Stone player, float* data) const {
-  // We assume the output liberties is a 3x19x19 tensor.
-  // == 1, == 2, >= 3
-  memset(data, 0, 3 * BOARD_SIZE * BOARD_SIZE * sizeof(float));
-  for (int i = 1; i < _board->_num_groups; ++i) {
-    if (S_ISA(_board->_groups[i].color, player)) {
-      int liberty = _board->_groups[i].liberties;
-      TRAVERSE(_board, i, c) {
-        if (liberty == 1) data[transform(c, 0)] = liberty;
-        else if (liberty == 2) data[transform(c, 1)] = liberty;
-        else data[transform(c, 2)] = liberty;
-      } ENDTRAVERSE
+  D4Tables() {
+    for (int code = 0; code < 8; ++code) {
+      auto rot = (BoardFeature::Rot)(code % 4);
+      for (int c = 0; c < BOUND_COORD; ++c) perm[code][c] = -1;
+      for (int i = 0; i < BOARD_SIZE; ++i) {
+        for (int j = 0; j < BOARD_SIZE; ++j) {
+          auto p = BoardFeature::Transform(make_pair(i, j), rot, code >= 4);
+          perm[code][OFFSETXY(i, j)] = EXPORT_OFFSET_XY(p.first, p.second);
+        }
+      }
     }
   }
+};
 
-  return true;
-}
+// exp(-age / 10) for the history planes.
+#define HISTORY_TABLE_SIZE 256
 
+struct HistoryTable {
+  float decay[HISTORY_TABLE_SIZE];
 
-bool BoardFeature::GetLibertyMap3binary(Stone player, float* data) const {
-  // We assume the output liberties is a 3x19x19 tensor.
-  // == 1, == 2, >= 3
-  memset(data, 0, 3 * BOARD_SIZE * BOARD_SIZE * sizeof(float));
-  for (int i = 1; i < _board->_num_groups; ++i) {
-    if (S_ISA(_board->_groups[i].color, player)) {
-      int liberty = _board->_groups[i].liberties;
-      TRAVERSE(_board, i, c) {
-        if (liberty == 1) data[transform(c, 0)] = 1.0;
-        else if (liberty == 2) data[transform(c, 1)] = 1.0;
-        else data[transform(c, 2)] = 1.0;
-      } ENDTRAVERSE
-    }
+  HistoryTable() {
+    for (int i = 0; i < HISTORY_TABLE_SIZE; ++i) decay[i] = exp(-i / 10.0);
   }
+};
 
-  return true;
-}
-
-
-bool BoardFeature::GetStones(Stone player, float *data) const {
-  memset(data, 0, BOARD_SIZE * BOARD_SIZE * sizeof(float));
-  for (int i = 0; i < BOARD_SIZE; ++i) {
-    for (int j = 0; j < BOARD_SIZE; ++j) {
-      Coord c = OFFSETXY(i, j);
-      if (_board->_infos[c].color == player) data[transform(i, j)] = 1;
-    }
-  }
-  return true;
-}
+}  // namespace
 
-bool BoardFeature::GetSimpleKo(Stone /*player*/, float *data) const {
-  memset(data, 0, BOARD_SIZE * BOARD_SIZE * sizeof(float));
-  Coord m = GetSimpleKoLocation(_board, NULL);
-  if (m != M_PASS) {
-    data[transform(m)] = 1;
-    return true;
-  }
-  return false;
+const short *BoardFeature::D4Permutation(Rot rot, bool flip) {
+  static const D4Tables tables;
+  return tables.perm[rot + (flip ? 4 : 0)];
 }
 
-// If player == S_EMPTY, get history of both sides.
-bool BoardFeature::GetHistory(Stone player, float *data) const {
-  memset(data, 0, BOARD_SIZE * BOARD_SIZE * sizeof(float));
-  for (int i = 0; i < BOARD_SIZE; ++i) {
-    for (int j = 0; j < BOARD_SIZE; ++j) {
-      Coord c = OFFSETXY(i, j);
-      if (S_ISA(_board->_infos[c].color, player)) data[transform(i, j)] = _board->_infos[c].last_placed;
-    }
-  }
-  return true;
+static inline float history_exp(int age) {
+  static const HistoryTable table;
+  return age >= 0 && age < HISTORY_TABLE_SIZE ? table.decay[age] : exp(-age / 10.0);
 }
 
-bool BoardFeature::GetHistoryExp(Stone player, float *data) const {
-  memset(data, 0, BOARD_SIZE * BOARD_SIZE * sizeof(float));
-  for (int i = 0; i < BOARD_SIZE; ++i) {
-    for (int j = 0; j < BOARD_SIZE; ++j) {
-      Coord c = OFFSETXY(i, j);
-      if (S_ISA(_board->_infos[c].color, player)) {
-          data[transform(i, j)] = exp( (_board->_infos[c].last_placed - _board->_ply) / 10.0 );
-      }
-    }
-  }
-  return true;
-}
-
-bool BoardFeature::GetDistanceMap(Stone player, float *data) const {
-  for (int i = 0; i < BOARD_SIZE; ++i) {
-    for (int j = 0; j < BOARD_SIZE; ++j) {
-      Coord c = OFFSETXY(i, j);
-      if (_board->_infos[c].color == player)
-        data[transform(i, j)] = 0;
-      else
-        data[transform(i, j)] = 10000;
-    }
-  }
-  DistanceTransform(data);
-  return true;
-}
-
-static float *board_plane(vector<float> *features, int idx) {
-    return &(*features)[idx * BOARD_SIZE * BOARD_SIZE];
-}
-
-#define LAYER(idx) board_plane(features, idx)
-
 /* darkforestGo/utils/goutils.lua
 extended = {
     "our liberties", "opponent liberties", "our simpleko", "our stones", "opponent stones", "empty stones", "our history", "opponent history",
@@ -173,24 +88,48 @@ extended = {
 */
 
 void BoardFeature::Extract(std::vector<float> *features) const {
-  Stone player = _board->_next_player;
-
   features->resize(MAX_NUM_FEATURE * BOARD_SIZE * BOARD_SIZE);
-  std::fill(features->begin(), features->end(), 0.0);
+  Extract(features->data());
+}
 
-  // Save the current board state to game state.
-  GetLibertyMap3binary(player, LAYER(OUR_LIB));
-  GetLibertyMap3binary(OPPONENT(player), LAYER(OPPONENT_LIB));
-  GetSimpleKo(player, LAYER(OUR_SIMPLE_KO));
+void BoardFeature::Extract(float *data) const {
+  Stone player = _board->_next_player;
+  memset(data, 0, MAX_NUM_FEATURE * BOARD_SIZE * BOARD_SIZE * sizeof(float));
+#define PLANE(idx) (data + (idx) * BOARD_SIZE * BOARD_SIZE)
 
-  GetStones(player, LAYER(OUR_STONES));
-  GetStones(OPPONENT(player), LAYER(OPPONENT_STONES));
-  GetStones(S_EMPTY, LAYER(EMPTY_STONES));
+  // Liberties (== 1, == 2, >= 3) of our and the opponent's groups, one-hot.
+  for (int i = 1; i < _board->_num_groups; ++i) {
+    const Group *g = &_board->_groups[i];
+    int idx = (g->color == player ? OUR_LIB : OPPONENT_LIB);
+    if (g->liberties == 2) idx += 1;
+    else if (g->liberties != 1) idx += 2;
+    float *plane = PLANE(idx);
+    TRAVERSE(_board, i, c) {
+      plane[_perm[c]] = 1.0;
+    } ENDTRAVERSE
+  }
 
-  GetHistoryExp(player, LAYER(OUR_HISTORY));
-  GetHistoryExp(OPPONENT(player), LAYER(OPPONENT_HISTORY));
+  Coord ko = GetSimpleKoLocation(_board, NULL);
+  if (ko != M_PASS) PLANE(OUR_SIMPLE_KO)[_perm[ko]] = 1.0;
 
-  GetDistanceMap(player, LAYER(OUR_CLOSEST_COLOR));
-  GetDistanceMap(OPPONENT(player), LAYER(OPPONENT_CLOSEST_COLOR));
+  // Stones, history and the seeds of the distance maps, in one pass over the board.
+  float *stones[3] = { PLANE(EMPTY_STONES), PLANE(OUR_STONES), PLANE(OPPONENT_STONES) };
+  float *history[3] = { NULL, PLANE(OUR_HISTORY), PLANE(OPPONENT_HISTORY) };
+  float *our_dist = PLANE(OUR_CLOSEST_COLOR);
+  float *opponent_dist = PLANE(OPPONENT_CLOSEST_COLOR);
+  for (int i = 0; i < BOARD_SIZE; ++i) {
+    for (int j = 0; j < BOARD_SIZE; ++j) {
+      Coord c = OFFSETXY(i, j);
+      const Info *info = &_board->_infos[c];
+      int idx = _perm[c];
+      int side = info->color == S_EMPTY ? 0 : (info->color == player ? 1 : 2);
+      stones[side][idx] = 1.0;
+      if (side > 0) history[side][idx] = history_exp(_board->_ply - info->last_placed);
+      our_dist[idx] = side == 1 ? 0 : 10000;
+      opponent_dist[idx] = side == 2 ? 0 : 10000;
+    }
+  }
+  DistanceTransform(our_dist);
+  DistanceTransform(opponent_dist);
+#undef PLANE
 }
-
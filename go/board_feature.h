@@ -31,19 +31,26 @@ class BoardFeature {
 public:
     enum Rot { NONE = 0, CCW90, CCW180, CCW270 };
 
-    BoardFeature(const Board &b, Rot rot, bool flip) : _board(&b), _rot(rot), _flip(flip) { }
-    BoardFeature(const Board &b) : _board(&b), _rot(NONE), _flip(false) { }
-    void SetD4Group(Rot new_rot, bool new_flip) { _rot = new_rot; _flip = new_flip; }
+    BoardFeature(const Board &b, Rot rot, bool flip) : _board(&b), _rot(rot), _flip(flip), _perm(D4Permutation(rot, flip)) { }
+    BoardFeature(const Board &b) : _board(&b), _rot(NONE), _flip(false), _perm(D4Permutation(NONE, false)) { }
+    void SetD4Group(Rot new_rot, bool new_flip) { _rot = new_rot; _flip = new_flip; _perm = D4Permutation(new_rot, new_flip); }
+
+    // For each Coord, its offset in a transformed plane (-1 if off board). Computed once per D4 element.
+    static const short *D4Permutation(Rot rot, bool flip);
 
     std::pair<int, int> Transform(const std::pair<int, int> &p) const {
+        return Transform(p, _rot, _flip);
+    }
+
+    static std::pair<int, int> Transform(const std::pair<int, int> &p, Rot rot, bool flip) {
         std::pair<int, int> output;
 
-        if (_rot == CCW90) output = std::make_pair(p.second, BOARD_SIZE - p.first - 1);
-        else if (_rot == CCW180) output = std::make_pair(BOARD_SIZE - p.first - 1, BOARD_SIZE - p.second - 1);
-        else if (_rot == CCW270) output = std::make_pair(BOARD_SIZE - p.second - 1, p.first);
+        if (rot == CCW90) output = std::make_pair(p.second, BOARD_SIZE - p.first - 1);
+        else if (rot == CCW180) output = std::make_pair(BOARD_SIZE - p.first - 1, BOARD_SIZE - p.second - 1);
+        else if (rot == CCW270) output = std::make_pair(BOARD_SIZE - p.second - 1, p.first);
         else output = p;
 
-        if (_flip) std::swap(output.first, output.second);
+        if (flip) std::swap(output.first, output.second);
         return output;
     }
 
@@ -71,32 +78,15 @@ public:
     }
 
     void Extract(std::vector<float> *features) const;
+    // Write the MAX_NUM_FEATURE planes straight into data (e.g. a batch slot, see
+    // GameState::WriteToSlot). Every plane is overwritten. The planes are a dense
+    // [MAX_NUM_FEATURE, BOARD_SIZE, BOARD_SIZE] block, which is what a slot of "s" is: the
+    // batch tensor is [batchsize, C, H, W], so no plane stride is needed.
+    void Extract(float *data) const;
 
 private:
     const Board *_board;
     Rot _rot;
     bool _flip;
-
-    int transform(int x, int y) const {
-        auto p = Transform(std::make_pair(x, y));
-        return EXPORT_OFFSET_XY(p.first, p.second);
-    }
-
-    int transform(Coord m) const {
-        return transform(X(m), Y(m));
-    }
-
-    int transform(Coord m, int c) const {
-        return transform(X(m), Y(m)) + c * BOARD_SIZE * BOARD_SIZE;
-    }
-
-    // Compute features.
-    bool GetLibertyMap3(Stone player, float* data) const;
-    bool GetLibertyMap(Stone player, float* data) const;
-    bool GetLibertyMap3binary(Stone player, float* data) const;
-    bool GetStones(Stone player, float *data) const;
-    bool GetSimpleKo(Stone player, float *data) const;
-    bool GetHistory(Stone player, float *data) const;
-    bool GetHistoryExp(Stone player, float *data) const;
-    bool GetDistanceMap(Stone player, float *data) const;
+    const short *_perm;
 };
@@ -21,11 +21,7 @@ GoGame::GoGame(int game_idx, const ContextOptions &context_options, const GameOp
   : _options(options), _context_options(context_options), _curr_loader_idx(0) {
     _game_idx = game_idx;
     if (options.seed == 0) {
-        auto now = chrono::system_clock::now();
-        auto now_ms = chrono::time_point_cast<chrono::milliseconds>(now);
-        auto value = now_ms.time_since_epoch();
-        long duration = value.count();
-        _seed = (time(NULL) * 1000 + duration + _game_idx * 2341479) % 100000000;
+        _seed = context_options.game_seed(_game_idx);
         if (_options.verbose) std::cout << "[" << _game_idx << "] Seed:" << _seed << std::endl;
     } else {
         _seed = options.seed;
@@ -37,17 +33,21 @@ void GoGame::Init(AIComm *ai_comm) {
     assert(ai_comm);
     if (_options.mode == "online" || _options.mode == "selfplay") {
         if (_options.use_mcts) {
-            auto *ai = new MCTSGoAI(ai_comm, _context_options.mcts_options);
+            mcts::TSOptions mcts_options = _context_options.mcts_options;
+            mcts_options.seed = _context_options.game_seed(_game_idx, 2);
+            auto *ai = new MCTSGoAI(ai_comm, mcts_options);
             _ai.reset(ai);
         } else {
             auto *ai = new DirectPredictAI();
             ai->InitAIComm(ai_comm);
             ai->SetActorName("actor");
             _ai.reset(ai);
+            _direct_ai = ai;
         }
     } else {
         // Open many offline instances.
-        for (int i = 0; i < _options.num_games_per_thread; ++i) {
+        int num_loaders = OfflineLoader::UseGameRecords() ? 1 : _options.num_games_per_thread;
+        for (int i = 0; i < num_loaders; ++i) {
             auto *loader = new OfflineLoader(_options, _seed + _game_idx * i * 997 + i * 13773 + 7);
             loader->InitAIComm(ai_comm);
             _loaders.emplace_back(loader);
@@ -71,26 +71,15 @@ void GoGame::Act(const elf::Signal &signal) {
         // For human player, at least you need to run Act once.
         if (_human_player != nullptr) {
             do {
-                _human_player->Act(_state, &c, &signal.done());
+                if (! _human_player->Act(_state, &c, &signal.done())) return;
                 if (_state.forward(c)) break;
                 // cout << "Invalid move: x = " << X(c) << " y = " << Y(c) << " move: " << coord2str(c) << " please try again" << endl;
             } while(! signal.PrepareStop());
         }
 
-        _ai->Act(_state, &c, &signal.done());
-        if (! _state.forward(c)) {
-            cout << _state.ShowBoard() << endl;
-            cout << "No valid move [" << c << "][" << coord2str(c) << "][" << coord2str2(c) << "], restarting the game" << endl;
-            _state.Reset();
-
-            if (_tar_writer != nullptr) {
-              _tar_writer->Write(std::to_string(_game_idx), coords2sgfstr(_moves));
-            }
-            _moves.clear();
-            _game_idx++;
-        } else {
-          _moves.push_back(c);
-        }
+        // No reply (e.g., the context is stopping), c was never set.
+        if (! _ai->Act(_state, &c, &signal.done())) return;
+        play(c);
     } else {
         // Replays hold a state by itself.
         _curr_loader_idx = _rng() % _loaders.size();
@@ -98,3 +87,47 @@ void GoGame::Act(const elf::Signal &signal) {
         loader->Act(&c, &signal.done());
     }
 }
+
+Context::CoopGame::Status GoGame::Step(const elf::Signal &signal) {
+    using CoopGame = Context::CoopGame;
+    if (signal.IsDone()) return CoopGame::DONE;
+
+    if (_sent) {
+        // The reply is already in, so this does not block.
+        _sent = false;
+        if (_direct_ai != nullptr) {
+            Coord c;
+            if (! _direct_ai->ActWaitReply(_state, &c)) return CoopGame::DONE;
+            play(c);
+        } else {
+            if (! _loaders[_curr_loader_idx]->ActWaitReply(nullptr)) return CoopGame::DONE;
+        }
+    }
+
+    bool sent;
+    if (_direct_ai != nullptr) {
+        sent = _direct_ai->ActSend(_state, &signal.done());
+    } else {
+        _curr_loader_idx = _rng() % _loaders.size();
+        sent = _loaders[_curr_loader_idx]->ActSend(&signal.done());
+    }
+    if (! sent) return CoopGame::DONE;
+    _sent = true;
+    return CoopGame::SENT;
+}
+
+void GoGame::play(Coord c) {
+    if (! _state.forward(c)) {
+        cout << _state.ShowBoard() << endl;
+        cout << "No valid move [" << c << "][" << coord2str(c) << "][" << coord2str2(c) << "], restarting the game" << endl;
+        _state.Reset();
+
+        if (_tar_writer != nullptr) {
+          _tar_writer->Write(std::to_string(_game_idx), coords2sgfstr(_moves));
+        }
+        _moves.clear();
+        _game_idx++;
+    } else {
+      _moves.push_back(c);
+    }
+}
@@ -20,6 +20,8 @@
 #include <random>
 #include <map>
 
+class DirectPredictAI;
+
 // Game interface for Go.
 class GoGame {
 private:
@@ -34,6 +36,10 @@ private:
 
     std::unique_ptr<AI> _ai;
     std::unique_ptr<AI> _human_player;
+    // _ai if it predicts moves directly (no MCTS). Step() can only drive this one.
+    DirectPredictAI *_direct_ai = nullptr;
+    // The last Step() sent data, the next one takes the reply.
+    bool _sent = false;
 
     // Only used when we want to run online
     GoState _state;
@@ -41,6 +47,8 @@ private:
     std::vector<Coord> _moves;
     std::unique_ptr<elf::tar::TarWriter> _tar_writer;
 
+    void play(Coord c);
+
 public:
     GoGame(int game_idx, const ContextOptions &context_options, const GameOptions& options);
 
@@ -54,5 +62,10 @@ public:
     }
 
     void Act(const elf::Signal &signal);
+
+    // Whether Step() can run this game. MCTS and the human player wait for replies inside Act().
+    bool CanStep() const { return _human_player == nullptr && (_ai == nullptr || _direct_ai != nullptr); }
+    // Act() split at the reply, for ContextT::StartCooperative.
+    Context::CoopGame::Status Step(const elf::Signal &signal);
     string ShowBoard() const { return _state.ShowBoard(); }
 };
@@ -7,7 +7,7 @@ from collections import Counter
 import argparse
 from time import sleep
 import os
-import go_game as go
+import importlib
 
 import sys
 sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
@@ -32,6 +32,7 @@ class Loader:
                 ("move_cutoff", dict(type=int, default=-1, help="Cutoff ply in replay")),
                 ("mode", "online"),
                 ("use_mcts", dict(action="store_true")),
+                ("board_size", dict(type=int, default=19, choices=[9, 13, 19], help="board size, 9 and 13 need go_game_9/go_game_13 (cmake -DGO_EXTRA_BOARD_SIZES=\"9;13\")")),
                 ("gpu", dict(type=int, default=None))
             ],
             more_args = ["batchsize", "T"],
@@ -40,6 +41,8 @@ class Loader:
 
     def initialize(self):
         args = self.args
+        # Only one go_game module can be loaded per process.
+        go = importlib.import_module("go_game" if args.board_size == 19 else "go_game_%d" % args.board_size)
         co = go.ContextOptions()
         self.context_args.initialize(co)
         co.print()
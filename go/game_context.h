@@ -31,24 +31,32 @@ class GameContext {
   public:
     GameContext(const ContextOptions& context_options, const GameOptions& options) {
       _context.reset(new GC{context_options, options});
+      // With the base seed resolved by the context.
       for (int i = 0; i < context_options.num_games; ++i) {
-          _games.emplace_back(new GoGame(i, context_options, options));
+          _games.emplace_back(new GoGame(i, _context->context_options(), options));
       }
-      if (! options.list_filename.empty()) OfflineLoader::InitSharedBuffer(options.list_filename);
+      if (! options.list_filename.empty()) OfflineLoader::InitSharedBuffer(options.list_filename, options);
     }
 
+    // With num_game_threads > 0, all games share that many threads (offline and direct-predict games only).
     void Start() {
+        if (_context->context_options().num_game_threads > 0) {
+            auto create = [this](int game_idx, const ContextOptions &context_options, const GameOptions&,
+                    GC::AIComm *ai_comm) -> GC::CoopGame * {
+                auto* game = init_game(game_idx, context_options, ai_comm);
+                if (! game->CanStep()) {
+                    throw std::range_error("num_game_threads > 0 only runs offline and direct-predict games, not MCTS or human play");
+                }
+                return new CoopGame(game);
+            };
+            _context->StartCooperative(create);
+            return;
+        }
+
         auto f = [this](int game_idx, const ContextOptions &context_options, const GameOptions&,
                 const elf::Signal& signal, GC::Comm* comm) {
             GC::AIComm ai_comm(game_idx, comm);
-            auto &state = ai_comm.info().data;
-            state.InitHist(context_options.T);
-            for (auto &s : state.v()) {
-                s.Init(game_idx, _num_action);
-            }
-            auto* game = _games[game_idx].get();
-            game->Init(&ai_comm);
-            game->MainLoop(signal);
+            init_game(game_idx, context_options, &ai_comm)->MainLoop(signal);
         };
         _context->Start(f);
     }
@@ -105,6 +113,31 @@ class GameContext {
 
     CONTEXT_CALLS(GC, _context);
 
+  private:
+    // Drives a GoGame owned by _games, in cooperative mode.
+    class CoopGame : public GC::CoopGame {
+      public:
+        CoopGame(GoGame *game) : _game(game) { }
+        Status Step(const elf::Signal &signal) override { return _game->Step(signal); }
+
+      private:
+        GoGame *_game;
+    };
+
+    GoGame *init_game(int game_idx, const ContextOptions &context_options, GC::AIComm *ai_comm) {
+        auto &state = ai_comm->info().data;
+        state.InitHist(context_options.T);
+        for (auto &s : state.v()) {
+            s.Init(game_idx, _num_action);
+            s.features_in_slot = context_options.batch_slots && context_options.T == 1;
+        }
+        auto* game = _games[game_idx].get();
+        game->Init(ai_comm);
+        return game;
+    }
+
+  public:
+
     void Stop() {
       _context.reset(nullptr);
       // [TODO] there may be issues when deleting shared_buffer.
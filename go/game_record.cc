@@ -0,0 +1,141 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+#include "game_record.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+
+bool GameRecordWriter::Add(const Sgf &sgf, const std::string &name) {
+    if (sgf.NumMoves() == 0 || sgf.GetBoardSize() > 31) return false;
+
+    GameRecordEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.move_offset = _moves.size();
+    entry.num_moves = sgf.NumMoves();
+    entry.name_offset = _names.size();
+    entry.komi = sgf.GetKomi();
+    entry.winner = sgf.GetWinner();
+    entry.handicap = sgf.GetHandicapStones();
+    entry.board_size = sgf.GetBoardSize();
+
+    auto it = sgf.begin();
+    for (int i = 0; i < sgf.NumMoves(); ++i, ++it) {
+        SgfMove m = it.GetCurrMove();
+        _moves.push_back(EncodeMove(m.player, m.move));
+    }
+
+    _names.append(name);
+    _names.push_back('\0');
+    _entries.push_back(entry);
+    return true;
+}
+
+bool GameRecordWriter::Write(const std::string &filename) const {
+    GameRecordFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GAME_RECORD_MAGIC, sizeof(header.magic));
+    header.version = GAME_RECORD_VERSION;
+    header.num_games = _entries.size();
+    header.num_moves = _moves.size();
+    header.moves_offset = sizeof(header) + _entries.size() * sizeof(GameRecordEntry);
+    header.names_offset = header.moves_offset + _moves.size() * sizeof(uint16_t);
+    header.names_size = _names.size();
+
+    std::ofstream oFile(filename, std::ios::binary);
+    if (! oFile.is_open()) {
+        std::cout << "Cannot open " << filename << " for writing" << std::endl;
+        return false;
+    }
+    oFile.write((const char *)&header, sizeof(header));
+    oFile.write((const char *)_entries.data(), _entries.size() * sizeof(GameRecordEntry));
+    oFile.write((const char *)_moves.data(), _moves.size() * sizeof(uint16_t));
+    oFile.write(_names.data(), _names.size());
+    return oFile.good();
+}
+
+GameRecordFile::GameRecordFile(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "Cannot open game records " << filename << std::endl;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(GameRecordFileHeader)) {
+        _size = st.st_size;
+        _data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        if (_data == MAP_FAILED) _data = nullptr;
+    }
+    close(fd);
+    if (_data == nullptr) {
+        std::cout << "Cannot map game records " << filename << std::endl;
+        return;
+    }
+
+    const char *base = (const char *)_data;
+    const auto *header = (const GameRecordFileHeader *)base;
+    if (! check(header)) {
+        std::cout << filename << " is not a valid game record file" << std::endl;
+        munmap(_data, _size);
+        _data = nullptr;
+        _size = 0;
+        return;
+    }
+    _header = header;
+    _entries = (const GameRecordEntry *)(base + sizeof(GameRecordFileHeader));
+    _moves = (const uint16_t *)(base + header->moves_offset);
+    _names = base + header->names_offset;
+}
+
+// All offsets have to stay inside the file, so that the accessors never read past the mapping.
+bool GameRecordFile::check(const GameRecordFileHeader *header) const {
+    if (memcmp(header->magic, GAME_RECORD_MAGIC, sizeof(header->magic)) != 0
+        || header->version != GAME_RECORD_VERSION) return false;
+
+    // Sections are in order: header, entries, moves and names.
+    const uint64_t entries_end = sizeof(GameRecordFileHeader) + (uint64_t)header->num_games * sizeof(GameRecordEntry);
+    if (entries_end > _size) return false;
+    if (header->moves_offset < entries_end || header->moves_offset > _size || header->moves_offset % sizeof(uint16_t) != 0) return false;
+    if (header->num_moves > (_size - header->moves_offset) / sizeof(uint16_t)) return false;
+    if (header->names_offset < header->moves_offset + header->num_moves * sizeof(uint16_t) || header->names_offset > _size) return false;
+    if (header->names_size > _size - header->names_offset) return false;
+
+    // Names are '\0'-terminated, so the last one ends inside the file.
+    const char *names = (const char *)_data + header->names_offset;
+    if (header->num_games > 0 && (header->names_size == 0 || names[header->names_size - 1] != '\0')) return false;
+
+    const auto *entries = (const GameRecordEntry *)((const char *)_data + sizeof(GameRecordFileHeader));
+    for (uint32_t i = 0; i < header->num_games; ++i) {
+        const GameRecordEntry &e = entries[i];
+        if (e.move_offset > header->num_moves || e.num_moves > header->num_moves - e.move_offset) return false;
+        if (e.name_offset >= header->names_size) return false;
+    }
+    return true;
+}
+
+GameRecordFile::~GameRecordFile() {
+    if (_data != nullptr) munmap(_data, _size);
+}
+
+int ConvertSgfTarToGameRecords(const std::string &tar_filename, const std::string &output_filename) {
+    elf::tar::TarLoader tar_loader(tar_filename);
+    GameRecordWriter writer;
+    int num_files = 0;
+    tar_loader.ForEach([&](const std::string &name, const std::string &contents) {
+        num_files ++;
+        Sgf sgf;
+        if (sgf.LoadFromString(name, contents)) writer.Add(sgf, name);
+    });
+    std::cout << "Converted " << writer.NumGames() << "/" << num_files << " games from " << tar_filename << std::endl;
+    if (! writer.Write(output_filename)) return -1;
+    return writer.NumGames();
+}
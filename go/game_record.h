@@ -0,0 +1,119 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "sgf.h"
+
+// Binary file of Go game records, converted once from sgf files and then mmapped.
+// Layout (little endian):
+//   GameRecordFileHeader
+//   GameRecordEntry[num_games]        the index, one entry per game
+//   uint16_t moves[num_moves]         moves of all games, packed (see EncodeMove)
+//   char names[names_size]            '\0'-terminated game names (e.g. the sgf file names)
+
+#define GAME_RECORD_MAGIC "ELFGOREC"
+#define GAME_RECORD_SUFFIX ".rec"
+#define GAME_RECORD_VERSION 1
+
+struct GameRecordFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_games;
+    uint64_t num_moves;
+    // Byte offsets in the file.
+    uint64_t moves_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+};
+
+struct GameRecordEntry {
+    // Index of the first move of the game in the moves array.
+    uint64_t move_offset;
+    uint32_t num_moves;
+    uint32_t name_offset;
+    float komi;
+    Stone winner;
+    uint8_t handicap;
+    uint8_t board_size;
+    uint8_t reserved;
+};
+
+// A move in 16 bits: bit 15 is set for White, x is in bits 5-9 and y in bits 0-4.
+// Only moves before the first pass are stored, the same as Sgf::NumMoves().
+inline uint16_t EncodeMove(Stone player, Coord c) {
+    return (player == S_WHITE ? 0x8000 : 0) | (X(c) << 5) | Y(c);
+}
+
+inline Coord DecodeMove(uint16_t m, Stone *player) {
+    if (player != nullptr) *player = (m & 0x8000) ? S_WHITE : S_BLACK;
+    return OFFSETXY((m >> 5) & 31, m & 31);
+}
+
+// Whether the move is on the board of this build, so that it can be decoded safely.
+inline bool MoveOnBoard(uint16_t m) {
+    return ((m >> 5) & 31) < BOARD_SIZE && (m & 31) < BOARD_SIZE;
+}
+
+// Collect games in memory, then write the file at once.
+class GameRecordWriter {
+public:
+    // Return false if the game cannot be stored (e.g. it has no moves).
+    bool Add(const Sgf &sgf, const std::string &name);
+    bool Write(const std::string &filename) const;
+    size_t NumGames() const { return _entries.size(); }
+
+private:
+    std::vector<GameRecordEntry> _entries;
+    std::vector<uint16_t> _moves;
+    std::string _names;
+};
+
+// Read-only view of a game record file. The file is mmapped, nothing is parsed.
+class GameRecordFile {
+public:
+    GameRecordFile(const std::string &filename);
+    // Owns the mapping.
+    GameRecordFile(const GameRecordFile &) = delete;
+    GameRecordFile &operator=(const GameRecordFile &) = delete;
+    ~GameRecordFile();
+
+    // Files whose offsets do not fit in the file are rejected when opened.
+    bool valid() const { return _header != nullptr; }
+    size_t NumGames() const { return valid() ? _header->num_games : 0; }
+    uint64_t NumMoves() const { return valid() ? _header->num_moves : 0; }
+
+    // i < NumGames().
+    const GameRecordEntry &GetEntry(size_t i) const { return _entries[i]; }
+    const uint16_t *GetMoves(size_t i) const { return _moves + _entries[i].move_offset; }
+    const char *GetName(size_t i) const { return _names + _entries[i].name_offset; }
+
+private:
+    void *_data = nullptr;
+    size_t _size = 0;
+
+    bool check(const GameRecordFileHeader *header) const;
+
+    const GameRecordFileHeader *_header = nullptr;
+    const GameRecordEntry *_entries = nullptr;
+    const uint16_t *_moves = nullptr;
+    const char *_names = nullptr;
+};
+
+inline bool file_is_game_record(const std::string &filename) {
+    const std::string suffix(GAME_RECORD_SUFFIX);
+    return filename.size() >= suffix.size() && filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Convert all sgf files in a tar archive. Return the number of games written, or -1 on error.
+int ConvertSgfTarToGameRecords(const std::string &tar_filename, const std::string &output_filename);
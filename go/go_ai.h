@@ -82,7 +82,7 @@ protected:
         gs.move_idx = state.GetPly();
         gs.winner = 0;
         const auto &bf = state.last_extractor();
-        bf.Extract(&gs.s);
+        gs.SetFeatures(bf);
         last_state_ = &state;
     }
 
@@ -109,7 +109,7 @@ protected:
         gs.move_idx = state.GetPly();
         gs.winner = 0;
         const auto &bf = state.last_extractor();
-        bf.Extract(&gs.s);
+        gs.SetFeatures(bf);
     }
 
     bool handle_response(const GoState &s, const Data &data, Coord *c) override {
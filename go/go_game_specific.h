@@ -13,6 +13,8 @@
 #include "elf/hist.h"
 #include "elf/copier.hh"
 
+#include "board_feature.h"
+
 struct GameOptions {
     // Seed.
     unsigned int seed;
@@ -56,6 +58,16 @@ struct GameOptions {
     REGISTER_PYBIND_FIELDS(seed, mode, data_aug, start_ratio_pre_moves, ratio_pre_moves, move_cutoff, num_planes, num_future_actions, list_filename, verbose, num_games_per_thread, use_mcts);
 };
 
+// Board features of a state being sent. They point into the board of the game that sent the
+// state, so copies of the state (history, replay) do not take them along.
+struct FeatureRef {
+    const BoardFeature *p = nullptr;
+
+    FeatureRef() { }
+    FeatureRef(const FeatureRef &) { }
+    FeatureRef &operator=(const FeatureRef &) { p = nullptr; return *this; }
+};
+
 struct GameState {
     using State = GameState;
     // Board state 19x19
@@ -81,7 +93,13 @@ struct GameState {
     std::vector<float> pi;
     float V;
 
-    void Clear() { game_record_idx = -1; aug_code = 0; winner = 0; move_idx = -1; }
+    // Batch slot mode with T = 1: s is not filled, the features are extracted straight into the
+    // batch slot when the state is sent (see WriteToSlot). Set by GameContext.
+    bool features_in_slot = false;
+    // Board features of the state being sent, valid until the reply. Cleared by Prepare.
+    FeatureRef features;
+
+    void Clear() { game_record_idx = -1; aug_code = 0; winner = 0; move_idx = -1; features.p = nullptr; }
 
     void Init(int iid, int num_action) {
         id = iid;
@@ -97,6 +115,22 @@ struct GameState {
         return *this;
     }
 
+    void SetFeatures(const BoardFeature &bf) {
+        if (features_in_slot) {
+            // Only the size of s is used.
+            s.resize(MAX_NUM_FEATURE * BOARD_SIZE * BOARD_SIZE);
+            features.p = &bf;
+        } else {
+            bf.Extract(&s);
+        }
+    }
+
+    bool WriteToSlot(const std::string &key, void *dst) const {
+        if (features.p == nullptr || key != "s") return false;
+        features.p->Extract(static_cast<float *>(dst));
+        return true;
+    }
+
     std::string PrintInfo() const {
         std::stringstream ss;
         ss << "[id:" << id << "][seq:" << seq << "][game_counter:" << game_counter << "][last_terminal:" << last_terminal << "]";
@@ -59,6 +59,11 @@ public:
     Coord LastMove2() const { return _board._last_move2; }
     Stone NextPlayer() const { return _board._next_player; }
 
+    // Zobrist hash of the position (stones, next player and ko), e.g. for transposition tables.
+    uint64_t GetHash() const { return GetPositionHash(&_board); }
+    // Zobrist hash of the stones only, e.g. for positional superko.
+    uint64_t GetStonesHash() const { return _board._hash; }
+
     vector<Coord> moves_since(int *move_number) const {
         if (*move_number < 0) {
             *move_number = _moves.size();
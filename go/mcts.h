@@ -25,11 +25,44 @@ public:
 
     void set_ostream(ostream *oo) { oo_ = oo; }
 
-    NodeResponse &evaluate(const GoState &s) {
-        ai_->Act(s, nullptr, nullptr);
-        ai_->get_last_pi(&resp_.pi, oo_);
-        resp_.value = ai_->get_last_value();
-        return resp_;
+    // Each extra comm lets one more leaf be in flight in evaluate_batch.
+    void AddBatchAIComm(AIComm *ai_comm) {
+        batch_ais_.emplace_back(new DirectPredictAI);
+        batch_ais_.back()->InitAIComm(ai_comm);
+        batch_ais_.back()->SetActorName("actor");
+    }
+
+    // Returns false if the reply did not come (done or cancelled).
+    bool evaluate(const GoState &s, NodeResponse *resp) {
+        if (! ai_->Act(s, nullptr, nullptr)) return false;
+        ai_->get_last_pi(&resp->pi, oo_);
+        resp->value = ai_->get_last_value();
+        return true;
+    }
+
+    // Send all states first so that they can be processed in the same batch, then collect the replies.
+    // Returns false if some reply did not come (done or cancelled).
+    bool evaluate_batch(const vector<const GoState *> &states, vector<NodeResponse> *resps) {
+        const size_t num_ais = batch_ais_.size() + 1;
+        for (size_t start = 0; start < states.size(); start += num_ais) {
+            const size_t end = std::min(states.size(), start + num_ais);
+            size_t sent = start;
+            while (sent < end && batch_ai(sent - start)->ActSend(*states[sent], nullptr)) sent ++;
+
+            bool ok = (sent == end);
+            // Wait for everything that was sent, so that no reply is left in flight.
+            for (size_t i = start; i < sent; ++i) {
+                DirectPredictAI *ai = batch_ai(i - start);
+                if (! ai->ActWaitReply(*states[i], nullptr)) {
+                    ok = false;
+                    continue;
+                }
+                ai->get_last_pi(&(*resps)[i].pi, oo_);
+                (*resps)[i].value = ai->get_last_value();
+            }
+            if (! ok) return false;
+        }
+        return true;
     }
 
     bool forward(GoState &s, Coord a) {
@@ -38,14 +71,19 @@ public:
 
     void SetId(int id) {
         ai_->SetId(id);
+        for (auto &ai : batch_ais_) ai->SetId(id);
     }
 
     string info() const { return string(); }
 
 protected:
-    NodeResponse resp_;
     unique_ptr<DirectPredictAI> ai_;
+    vector<unique_ptr<DirectPredictAI>> batch_ais_;
     ostream *oo_ = nullptr;
+
+    DirectPredictAI *batch_ai(size_t i) {
+        return i == 0 ? ai_.get() : batch_ais_[i - 1].get();
+    }
 };
 
 using MCTSGoAI = elf::MCTSAIWithCommT<MCTSActor, AIComm>;
@@ -7,23 +7,47 @@
 */
 #include "offpolicy_loader.h"
 
+#include <algorithm>
 #include <fstream>
+#include <stdexcept>
 
 ///////////// OfflineLoader ////////////////////
 std::unique_ptr<elf::tar::TarLoader> OfflineLoader::_tar_loader;
 vector<string> OfflineLoader::_games;
 string OfflineLoader::_list_filename;
 string OfflineLoader::_path;
+std::unique_ptr<GameRecordFile> OfflineLoader::_records;
+vector<uint64_t> OfflineLoader::_usable_before;
 
 OfflineLoader::OfflineLoader(const GameOptions &options, int seed)
     : _options(options), _game_loaded(0), _rng(seed) {
-      ReplayLoader::Reload();
+      if (_records != nullptr) sample_record();
+      else ReplayLoader::Reload();
 }
 
-void OfflineLoader::InitSharedBuffer(const std::string &list_filename) {
+void OfflineLoader::InitSharedBuffer(const std::string &list_filename, const GameOptions &options) {
 
     if (list_filename.empty()) return;
 
+    if (file_is_game_record(list_filename)) {
+        _records.reset(new GameRecordFile(list_filename));
+        if (! _records->valid() || _records->NumGames() == 0) {
+            _records.reset();
+            return;
+        }
+        _list_filename = list_filename;
+        uint64_t num_usable = init_usable(options);
+        std::cout << "Loaded game records: " << list_filename << " #Game: " << _records->NumGames()
+                  << " #Moves: " << _records->NumMoves() << " #Usable: " << num_usable << std::endl;
+        if (num_usable == 0) {
+            _records.reset();
+            throw std::range_error("No usable position in " + list_filename + " for board size " + std::to_string(BOARD_SIZE)
+                + ", num_future_actions = " + std::to_string(options.num_future_actions)
+                + ", move_cutoff = " + std::to_string(options.move_cutoff));
+        }
+        return;
+    }
+
     if (elf::tar::file_is_tar(list_filename)) {
         _tar_loader.reset(new elf::tar::TarLoader(list_filename));
         _games = _tar_loader->List();
@@ -125,11 +149,59 @@ void OfflineLoader::next() {
     else ReplayLoader::increment();
 }
 
+// Same conditions as after_reload() and need_reload(): the moves of a game that can be sampled are [0, usable).
+uint64_t OfflineLoader::usable_moves(const GameRecordEntry &entry, const GameOptions &options) {
+    if (entry.num_moves < 10 || entry.board_size != BOARD_SIZE) return 0;
+    int64_t usable = (int64_t)entry.num_moves - options.num_future_actions;
+    if (options.move_cutoff >= 0) usable = std::min<int64_t>(usable, options.move_cutoff);
+    return std::max<int64_t>(usable, 0);
+}
+
+uint64_t OfflineLoader::init_usable(const GameOptions &options) {
+    _usable_before.assign(1, 0);
+    for (size_t i = 0; i < _records->NumGames(); ++i) {
+        _usable_before.push_back(_usable_before.back() + usable_moves(_records->GetEntry(i), options));
+    }
+    return _usable_before.back();
+}
+
+void OfflineLoader::sample_record() {
+    // Picking the k-th usable position keeps (game, move) uniform among them.
+    std::uniform_int_distribution<uint64_t> dist(0, _usable_before.back() - 1);
+
+    // Only games with illegal or off-board moves are retried.
+    for (int retry = 0; retry < kMaxSampleRetries; ++retry) {
+        uint64_t k = dist(_rng);
+        size_t game = std::upper_bound(_usable_before.begin(), _usable_before.end(), k) - _usable_before.begin() - 1;
+        const GameRecordEntry &entry = _records->GetEntry(game);
+        int move = k - _usable_before[game];
+
+        s().Reset();
+        s().ApplyHandicap(entry.handicap);
+        const uint16_t *moves = _records->GetMoves(game);
+        int i = 0;
+        while (i < move && MoveOnBoard(moves[i]) && s().forward(DecodeMove(moves[i], nullptr))) i ++;
+        if (i < move) continue;
+        // The next move and the future moves saved in offline_a have to be on the board too.
+        int end = move + std::max(_options.num_future_actions, 1);
+        while (i < end && MoveOnBoard(moves[i])) i ++;
+        if (i < end) continue;
+
+        _curr_game = game;
+        _record_move = move;
+        _game_loaded ++;
+        if (_options.verbose) print_context();
+        return;
+    }
+    throw std::range_error("Cannot replay any sampled game of " + _list_filename + " after "
+        + std::to_string(kMaxSampleRetries) + " tries, the records have illegal moves");
+}
+
 void OfflineLoader::extract(Data *data) {
     auto& gs = data->newest();
     gs.game_record_idx = _curr_game;
     gs.move_idx = s().GetPly();
-    Stone winner = this->curr().GetSgf().GetWinner();
+    Stone winner = _records != nullptr ? _records->GetEntry(_curr_game).winner : this->curr().GetSgf().GetWinner();
     gs.winner = (winner == S_BLACK ? 1 : (winner == S_WHITE ? -1 : 0));
 
     int code = _options.data_aug;
@@ -140,12 +212,17 @@ void OfflineLoader::extract(Data *data) {
     bool flip = (code >> 2) == 1;
     const BoardFeature &bf = s().extractor(rot, flip);
 
-    bf.Extract(&gs.s);
+    gs.SetFeatures(bf);
     save_forward_moves(bf, &gs.offline_a);
 }
 
 bool OfflineLoader::handle_response(const Data &data, Coord *c) {
     (void)data;
+    if (_records != nullptr) {
+        *c = DecodeMove(_records->GetMoves(_curr_game)[_record_move], nullptr);
+        sample_record();
+        return true;
+    }
     *c = curr().GetCoord();
     next();
     return true;
@@ -153,7 +230,17 @@ bool OfflineLoader::handle_response(const Data &data, Coord *c) {
 
 bool OfflineLoader::save_forward_moves(const BoardFeature &bf, vector<int64_t> *actions) const {
     assert(actions);
-    vector<SgfMove> future_moves = curr().GetForwardMoves(_options.num_future_actions);
+    vector<SgfMove> future_moves;
+    if (_records != nullptr) {
+        const uint16_t *moves = _records->GetMoves(_curr_game) + _record_move;
+        for (int i = 0; i < _options.num_future_actions; ++i) {
+            SgfMove m;
+            m.move = DecodeMove(moves[i], &m.player);
+            future_moves.push_back(m);
+        }
+    } else {
+        future_moves = curr().GetForwardMoves(_options.num_future_actions);
+    }
     if ((int)future_moves.size() < _options.num_future_actions) return false;
 
     actions->resize(_options.num_future_actions);
@@ -11,6 +11,7 @@
 #include "elf/replay_loader.h"
 #include "elf/tar_loader.h"
 #include "ai.h"
+#include "game_record.h"
 
 using namespace std;
 
@@ -21,7 +22,11 @@ public:
 
 public:
     OfflineLoader(const GameOptions &options, int seed);
-    static void InitSharedBuffer(const std::string &list_filename);
+    // list_filename is a list of sgf files, a tar of sgf files, or a game record file (.rec).
+    // Throw std::range_error if a game record file has no position usable with options.
+    static void InitSharedBuffer(const std::string &list_filename, const GameOptions &options);
+    // With game records, one loader per thread is enough since every position is sampled anew.
+    static bool UseGameRecords() { return _records != nullptr; }
 
 protected:
     // Database
@@ -30,6 +35,13 @@ protected:
     static string _list_filename;
     static string _path;
 
+    // Mmapped game records shared by all loaders. If loaded, each position is a (game, move) pair
+    // sampled uniformly over the whole corpus, and replayed from the packed moves.
+    static std::unique_ptr<GameRecordFile> _records;
+    // Number of usable positions in the games before game i, with one more entry for the total.
+    static vector<uint64_t> _usable_before;
+    static constexpr int kMaxSampleRetries = 10000;
+
     GameOptions _options;
 
     // Current game, its sgf record and game board state.
@@ -37,6 +49,9 @@ protected:
     int _game_loaded;
     std::mt19937 _rng;
 
+    // Current move in the game record.
+    int _record_move = 0;
+
     // Virtual function for ReplayLoader:
     std::string get_key() override;
     bool after_reload(const std::string &full_name, Sgf::iterator &it) override;
@@ -44,6 +59,9 @@ protected:
     // Helper function.
     bool need_reload(const Sgf::iterator &it) const;
     void next();
+    void sample_record();
+    static uint64_t usable_moves(const GameRecordEntry &entry, const GameOptions &options);
+    static uint64_t init_usable(const GameOptions &options);
 
     // Virtual function for AIHoldStateWithComm
     void before_act(const std::atomic_bool *) override { 
@@ -62,6 +80,11 @@ protected:
     }
 
     void print_context() const {
+        if (_records != nullptr) {
+            cout << "[curr_game=" << _curr_game << "][name=" << _records->GetName(_curr_game) << "] "
+                 << _record_move << "/" << _records->GetEntry(_curr_game).num_moves << endl;
+            return;
+        }
         cout << "[curr_game=" << _curr_game << "][filename=" << _games[_curr_game] << "] " << info() << endl;
     }
 
@@ -15,10 +15,16 @@
 #include "../elf/pybind_helper.h"
 
 #include "game_context.h"
+#include "game_record.h"
 
 namespace py = pybind11;
 
-PYBIND11_MODULE(go_game, m) {
+// Modules built for other board sizes are named go_game_<size> (see GO_BOARD_SIZE in board.h).
+#ifndef GO_MODULE_NAME
+#define GO_MODULE_NAME go_game
+#endif
+
+PYBIND11_MODULE(GO_MODULE_NAME, m) {
   register_common_func<GameContext>(m);
 
   CONTEXT_REGISTER(GameContext)
@@ -31,4 +37,7 @@ PYBIND11_MODULE(go_game, m) {
   PYCLASS_WITH_FIELDS(m, GameOptions)
     .def(py::init<>());
 
+  // Convert a tar of sgf files to the binary game record format (see game_record.h).
+  m.def("ConvertSgfTarToGameRecords", &ConvertSgfTarToGameRecords);
+
 }
@@ -25,8 +25,10 @@ static std::string trim(const std::string& str) {
 typedef pair<int, int> seg;
 
 bool Sgf::load_game(const string& filename, const string& game_string) {
-    const char *str = game_string.c_str();
-    int len = game_string.size();
+    return load_game(filename, game_string.c_str(), game_string.size());
+}
+
+bool Sgf::load_game(const string& filename, const char *str, int len) {
 
     _header.Reset();
     int next_offset = 0;
@@ -56,8 +58,13 @@ bool Sgf::load_game(const string& filename, const string& game_string) {
     return false;
 }
 
-bool Sgf::Load(const string& filename, elf::tar::TarLoader& tar_loader) {
-  return load_game(filename, tar_loader.Load(filename));
+bool Sgf::Load(const string& filename, const elf::tar::TarLoader& tar_loader) {
+  auto view = tar_loader.View(filename);
+  if (view.first == nullptr) {
+    std::cout << "Cannot find " << filename << " in the tar file" << std::endl;
+    return false;
+  }
+  return load_game(filename, view.first, view.second);
 }
 
 bool Sgf::Load(const string& filename) {
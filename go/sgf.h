@@ -125,6 +125,7 @@ private:
 
     static SgfEntry *load(const char *s, const std::pair<int, int>& range, int *next_offset);
     bool load_game(const string& filename, const string& game);
+    bool load_game(const string& filename, const char *game, int len);
 
 public:
     class iterator {
@@ -179,12 +180,15 @@ public:
 
     Sgf() : _num_moves(0) { }
     bool Load(const string& filename);
-    bool Load(const string& gamename, elf::tar::TarLoader& tar_loader);
+    bool Load(const string& gamename, const elf::tar::TarLoader& tar_loader);
+    // Load from the contents of an sgf file. gamename is only used in messages.
+    bool LoadFromString(const string& gamename, const string& contents) { return load_game(gamename, contents); }
 
     iterator begin() const { return iterator(*this); }
 
     Stone GetWinner() const { return _header.winner; }
     int GetHandicapStones() const { return _header.handi; }
+    float GetKomi() const { return _header.komi; }
     int GetBoardSize() const { return _header.size; }
     int NumMoves() const { return _num_moves; }
 
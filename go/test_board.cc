@@ -0,0 +1,96 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+// Play random games and check the board against slower references after every move:
+// the incremental hash matches ComputeStoneHash(), the legal moves from GetLegalMoves() agree
+// with TryPlay2() on every point, and a random reading played with PlayWithUndo() and taken back
+// with UndoPlay() restores the board byte for byte.
+
+#include <string.h>
+#include <iostream>
+#include <random>
+#include "board.h"
+
+using namespace std;
+
+static const int kNumGames = 50;
+static const int kReadingDepth = 8;
+
+static int hash_mismatches = 0;
+static int mismatches = 0;
+static int undo_mismatches = 0;
+
+static void check_legal_moves(const Board *board) {
+  Bitboard legal;
+  GetLegalMoves(board, board->_next_player, &legal);
+  GroupId4 ids;
+  for (int x = 0; x < BOARD_SIZE; ++x) {
+    for (int y = 0; y < BOARD_SIZE; ++y) {
+      Coord c = OFFSETXY(x, y);
+      if ((bool)BITBOARD_HAS(&legal, c) != TryPlay2(board, c, &ids)) mismatches ++;
+    }
+  }
+}
+
+// Pick a random move that TryPlay2 accepts, or pass now and then and when there is none.
+static Coord random_move(const Board *board, mt19937 *rng) {
+  vector<Coord> moves;
+  GroupId4 ids;
+  for (int x = 0; x < BOARD_SIZE; ++x) {
+    for (int y = 0; y < BOARD_SIZE; ++y) {
+      Coord c = OFFSETXY(x, y);
+      if (TryPlay2(board, c, &ids)) moves.push_back(c);
+    }
+  }
+  if (moves.empty() || (*rng)() % 50 == 0) return M_PASS;
+  return moves[(*rng)() % moves.size()];
+}
+
+static void check_undo(const Board *board, BoardUndo *undo, mt19937 *rng) {
+  Board b;
+  CopyBoard(&b, board);
+  GroupId4 ids;
+  int depth = 1 + (*rng)() % kReadingDepth;
+  for (int i = 0; i < depth && ! IsGameEnd(&b); ++i) {
+    TryPlay2(&b, random_move(&b, rng), &ids);
+    PlayWithUndo(&b, &ids, undo);
+  }
+  while (! undo->moves.empty()) UndoPlay(&b, undo);
+  if (memcmp(&b, board, sizeof(Board)) != 0) undo_mismatches ++;
+}
+
+static long play_game(mt19937 *rng) {
+  Board board;
+  ClearBoard(&board);
+  GroupId4 ids;
+  BoardUndo undo;
+  long plies = 0;
+  while (! IsGameEnd(&board) && plies < 3 * BOARD_SIZE * BOARD_SIZE) {
+    if (board._hash != ComputeStoneHash(&board)) hash_mismatches ++;
+    check_legal_moves(&board);
+    if (plies % 5 == 0) check_undo(&board, &undo, rng);
+    Coord m = random_move(&board, rng);
+    TryPlay2(&board, m, &ids);
+    Play(&board, &ids);
+    plies ++;
+  }
+  return plies;
+}
+
+int main() {
+  mt19937 rng(1);
+  long plies = 0;
+  for (int i = 0; i < kNumGames; ++i) plies += play_game(&rng);
+
+  cout << BOARD_SIZE << "x" << BOARD_SIZE << ": " << kNumGames << " games, " << plies << " plies, "
+       << hash_mismatches << " hash mismatches, " << mismatches << " legal move mismatches, "
+       << undo_mismatches << " boards changed by undo" << endl;
+  bool ok = hash_mismatches == 0 && mismatches == 0 && undo_mismatches == 0;
+  cout << (ok ? "PASSED" : "FAILED") << endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+// Run many synthetic games on a few threads with ContextT::StartCooperative, and check that every
+// game gets its own replies, is never stepped twice at once, and that Stop() works mid-run.
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include "elf/comm_template.h"
+
+using namespace std;
+
+struct CoopState {
+    using State = CoopState;
+    vector<float> s;
+    int32_t id = -1, seq = 0, game_counter = 0;
+    char last_terminal = 0;
+    int64_t a = 0;
+
+    CoopState() : s(2) { }
+    CoopState &Prepare(const SeqInfo &seq_info) {
+        seq = seq_info.seq;
+        game_counter = seq_info.game_counter;
+        last_terminal = seq_info.last_terminal;
+        return *this;
+    }
+    void Restart() { }
+
+    DECLARE_FIELD(CoopState, id, seq, game_counter, last_terminal, s, a);
+    REGISTER_PYBIND_FIELDS(id, seq);
+};
+
+struct CoopOptions { };
+
+using Context = ContextT<CoopOptions, HistT<CoopState>>;
+using AIComm = Context::AIComm;
+
+static const int kSteps = 30;
+static const int kBatchSize = 8;
+
+static atomic<int> wrong_replies(0);
+static atomic<int> overlaps(0);
+
+// Sends (game, step) and expects game * 1000 + step back. Yields now and then, and keeps
+// running for a bit after SendData() so that replies often come before Step() returns.
+class CoopGame : public Context::CoopGame {
+public:
+    CoopGame(int idx, AIComm *ai_comm) : _idx(idx), _ai_comm(ai_comm) { _ai_comm->info().data.InitHist(1); }
+
+    Status Step(const elf::Signal &signal) override {
+        if (_in_step.exchange(true)) overlaps ++;
+        Status status = step(signal);
+        if (status == SENT) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        _in_step = false;
+        return status;
+    }
+
+private:
+    int _idx;
+    AIComm *_ai_comm;
+    int _k = 0;
+    bool _yielded = false;
+    atomic_bool _in_step{false};
+
+    Status step(const elf::Signal &signal) {
+        if (_k > 0 && ! _yielded && _ai_comm->info().data.newest().a != _idx * 1000 + _k - 1) wrong_replies ++;
+        if (_k == kSteps || signal.IsDone()) return DONE;
+        if ((_idx + _k) % 7 == 0 && ! _yielded) {
+            _yielded = true;
+            return YIELD;
+        }
+        _yielded = false;
+        auto &state = _ai_comm->Prepare();
+        state.id = _idx;
+        state.s[0] = _idx;
+        state.s[1] = _k;
+        _k ++;
+        return _ai_comm->SendData() ? SENT : DONE;
+    }
+};
+
+// Stop after max_items replies, or when all games are done if max_items is 0.
+static bool run(int num_games, int num_game_threads, long max_items) {
+    ContextOptions context_options;
+    context_options.num_games = num_games;
+    context_options.num_game_threads = num_game_threads;
+    context_options.T = 1;
+
+    Context context(context_options, CoopOptions());
+    GroupStat gstat;
+    gstat.hist_len = 1;
+    int gid = context.comm().AddCollectors(kBatchSize, 0, 1000, gstat);
+    auto &group = context.comm().GetCollectorGroup(gid);
+
+    vector<float> s(kBatchSize * 2);
+    vector<int64_t> a(kBatchSize);
+    auto add_entry = [&](const string &input_reply, const string &key, void *p, size_t byte_size) {
+        EntryInfo entry = group.GetEntry(key, 1, [](const string &k) { return EntryInfo(k, ""); });
+        entry.p = (uint64_t)p;
+        entry.byte_size = byte_size;
+        group.AddEntry(input_reply, entry);
+    };
+    add_entry("input", "s", s.data(), s.size() * sizeof(float));
+    add_entry("reply", "a", a.data(), a.size() * sizeof(int64_t));
+
+    context.StartCooperative([](int game_idx, const ContextOptions &, const CoopOptions &, AIComm *ai_comm) {
+        return new CoopGame(game_idx, ai_comm);
+    });
+
+    const long total = (max_items > 0 ? max_items : (long)num_games * kSteps);
+    long items = 0;
+    while (items < total) {
+        auto infos = context.Wait(1000);
+        if (infos.gid < 0) continue;
+        for (int i = 0; i < infos.batchsize(); ++i) {
+            a[i] = (int64_t)s[2 * i] * 1000 + (int64_t)s[2 * i + 1];
+        }
+        items += infos.batchsize();
+        context.Steps(infos);
+    }
+    context.Stop();
+
+    cout << num_games << " games on " << num_game_threads << " threads: " << items << " replies, "
+         << wrong_replies << " wrong, " << overlaps << " overlapping steps" << endl;
+    return wrong_replies == 0 && overlaps == 0 && (max_items > 0 || items == total);
+}
+
+int main() {
+    bool ok = run(500, 4, 0) && run(500, 4, 500 * kSteps / 2);
+    cout << (ok ? "PASSED" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+/**
+* Copyright (c) 2017-present, Facebook, Inc.
+* All rights reserved.
+
+* This source code is licensed under the BSD-style license found in the
+* LICENSE file in the root directory of this source tree.
+*/
+
+// Check that the transposition table merges Go positions reached by different move orders,
+// and that a failed batch evaluation leaves no trace in the tree.
+
+#include <atomic>
+#include <iostream>
+#include "elf/tree_search.h"
+#include "go_state.h"
+
+using namespace std;
+
+// Only plays the four corner star points, so the same positions show up in many orders.
+class CornerActor {
+public:
+    using NodeResponse = mcts::NodeResponseT<Coord>;
+
+    bool evaluate(const GoState &s, NodeResponse *resp) {
+        resp->pi.clear();
+        for (const Coord &c : moves()) {
+            if (s.CheckMove(c)) resp->pi.push_back(make_pair(c, 0.25f));
+        }
+        resp->value = 0.5;
+        return true;
+    }
+
+    bool forward(GoState &s, Coord a) { return s.forward(a); }
+    string info() const { return string(); }
+
+    static vector<Coord> moves() {
+        return { GetCoord(3, 3), GetCoord(15, 15), GetCoord(3, 15), GetCoord(15, 3) };
+    }
+};
+
+using TreeSearch = mcts::TreeSearchT<GoState, Coord, CornerActor>;
+
+// Evaluation that fails once evals_left runs out, as if the game was stopped. A batch counts as one.
+static std::atomic<int> evals_left(0);
+
+class FailingActor : public CornerActor {
+public:
+    bool evaluate(const GoState &s, NodeResponse *resp) {
+        if (evals_left.fetch_sub(1) <= 0) return false;
+        return CornerActor::evaluate(s, resp);
+    }
+
+    bool evaluate_batch(const vector<const GoState *> &states, vector<NodeResponse> *resps) {
+        if (evals_left.fetch_sub(1) <= 0) return false;
+        for (size_t i = 0; i < states.size(); ++i) CornerActor::evaluate(*states[i], &(*resps)[i]);
+        return true;
+    }
+};
+
+static mcts::NodeId descend(const TreeSearch &ts, const vector<Coord> &path) {
+    const auto &alloc = ts.alloc();
+    mcts::NodeId id = alloc.root_id();
+    for (const Coord &c : path) {
+        const auto *node = alloc[id];
+        if (node == nullptr) return mcts::NodeIdInvalid;
+        id = node->Descent(c);
+    }
+    return id;
+}
+
+static bool run(bool use_table) {
+    mcts::TSOptions options;
+    options.num_threads = 4;
+    options.num_rollout_per_thread = 500;
+    options.use_prior = true;
+    options.use_transposition_table = use_table;
+
+    TreeSearch ts(options, [](int) { return new CornerActor(); });
+    GoState s;
+    ts.Run(s);
+
+    const auto m = CornerActor::moves();
+    // Black m[0], m[2] and White m[1] in two orders, White to play in both.
+    mcts::NodeId id1 = descend(ts, { m[0], m[1], m[2] });
+    mcts::NodeId id2 = descend(ts, { m[2], m[1], m[0] });
+
+    // Shared nodes survive TreeAdvance.
+    ts.TreeAdvance(m[0]);
+    s.forward(m[0]);
+    ts.Run(s);
+    mcts::NodeId id3 = descend(ts, { m[1], m[2], m[3] });
+    mcts::NodeId id4 = descend(ts, { m[3], m[2], m[1] });
+    ts.Stop();
+
+    cout << "Transposition table: " << (use_table ? "on" : "off") << ", nodes: "
+         << id1 << " " << id2 << ", after TreeAdvance: " << id3 << " " << id4 << endl;
+    if (id1 == mcts::NodeIdInvalid || id3 == mcts::NodeIdInvalid) return false;
+    return (id1 == id2) == use_table && (id3 == id4) == use_table;
+}
+
+// Batched search on a small tree, so that many leaves collide. Collisions must not use rollouts.
+static bool run_batched() {
+    mcts::TSOptions options;
+    options.num_threads = 4;
+    options.num_rollout_per_thread = 200;
+    options.use_prior = true;
+    options.leaf_batch_size = 8;
+
+    TreeSearch ts(options, [](int) { return new CornerActor(); });
+    GoState s;
+    ts.Run(s);
+    int count = ts.alloc().root()->count();
+    ts.Stop();
+
+    cout << "Leaf batch " << options.leaf_batch_size << ": root count " << count << ", expected "
+         << options.num_threads * options.num_rollout_per_thread << endl;
+    return count == options.num_threads * options.num_rollout_per_thread;
+}
+
+static bool run_failing(int leaf_batch_size, int fail_after) {
+    mcts::TSOptions options;
+    options.num_threads = 2;
+    options.num_rollout_per_thread = 200;
+    options.use_prior = true;
+    options.persistent_tree = true;
+    options.leaf_batch_size = leaf_batch_size;
+
+    mcts::TreeSearchT<GoState, Coord, FailingActor> ts(options, [](int) { return new FailingActor(); });
+    GoState s;
+    evals_left = fail_after;
+    // Nothing to pick if the root was never evaluated.
+    bool found = ts.Run(s).found();
+    // Dropped leaves can be expanded again later.
+    evals_left = 1000000;
+    ts.Run(s);
+    ts.Stop();
+
+    // Without virtual loss left over, the visits of the root edges add up to the root count.
+    // A leaf expanded from a missing reply would have no moves.
+    const auto *root = ts.alloc().root();
+    int n = 0, empty = 0;
+    for (const auto &p : root->sa()) {
+        n += p.second.n;
+        const auto *child = ts.alloc()[p.second.next];
+        if (child != nullptr && child->visited() && child->sa().empty()) empty ++;
+    }
+    cout << "Leaf batch " << leaf_batch_size << ", evaluation fails after " << fail_after << " calls: root count " << root->count()
+         << ", sum of edge visits " << n << ", children without moves " << empty << endl;
+    return n == root->count() && root->count() > 0 && empty == 0 && found == (fail_after > 0);
+}
+
+int main() {
+    bool ok = run(false) && run(true) && run_batched() && run_failing(4, 0) && run_failing(4, 5)
+        && run_failing(1, 0) && run_failing(1, 5);
+    cout << (ok ? "PASSED" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
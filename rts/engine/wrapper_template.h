@@ -33,7 +33,7 @@ public:
 
         // Create a game.
         RTSGameOptions op;
-        op.seed = (options.seed == 0 ? 0 : options.seed + game_idx);
+        op.seed = (options.seed == 0 ? context_options.game_seed(game_idx) : options.seed + game_idx);
         op.main_loop_quota = 0;
         op.max_tick = options.max_tick;
         op.save_replay_prefix = (replay_prefix.empty() ? "" : replay_prefix + std::to_string(game_idx) + "-");
@@ -56,9 +56,8 @@ public:
 
         s.SetGlobalStats(&_gstats);
 
-        unsigned long int seed = (op.seed == 0 ? time(NULL) : op.seed);
         std::mt19937 rng;
-        rng.seed(seed);
+        rng.seed(op.seed);
 
         int iter = 0;
         // std::cout << "Start the main loop" << std::endl;
@@ -80,10 +80,11 @@ public:
         return ai.Act(state, &s->state, nullptr);
     }
 
-    Response &evaluate(const State &s) {
+    bool evaluate(const State &s, Response *resp) {
         auto &ai = ai_.predict;
-        ai.Act(s.state, &resp_, nullptr);
-        return resp_;
+        if (! ai.Act(s.state, &resp_, nullptr)) return false;
+        *resp = resp_;
+        return true;
     }
 
     bool forward(State &s, const Action &a) {
@@ -153,15 +154,15 @@ public:
 
     MCTSActor() { }
 
-    Response &evaluate(const RTSState &) {
+    bool evaluate(const RTSState &, Response *resp) {
         assert(game_.get());
         // Uniform distribution on resp.
-        resp_.pi.resize(NUM_AISTATE);
+        resp->pi.resize(NUM_AISTATE);
         for (int i = 0; i < NUM_AISTATE; ++i) {
-            resp_.pi[i] = make_pair(i, 1.0 / NUM_AISTATE);
+            resp->pi[i] = make_pair(i, 1.0 / NUM_AISTATE);
         }
-        resp_.value = 0.0;
-        return resp_;
+        resp->value = 0.0;
+        return true;
     }
 
     float reward(const RTSState &s) const {
@@ -211,7 +212,6 @@ public:
     }
 
 protected:
-    Response resp_;
     unique_ptr<RTSGame> game_;
     FixedAI *ai_;
 };
@@ -68,11 +68,14 @@ void WrapperCallbacks::OnGameOptions(RTSGameOptions *rts_options) {
 void WrapperCallbacks::OnGameInit(RTSGame *game, const std::map<std::string, int> *more_params) {
     // std::cout << "Initialize opponent" << std::endl;
     std::vector<AI *> ais;
+    mcts::TSOptions mcts_options = _context_options.mcts_options;
     for (const AIOptions &ai_opt : _options.ai_options) {
         Context::AIComm *ai_comm = new Context::AIComm(_game_idx, _comm);
         _ai_comms.emplace_back(ai_comm);
         initialize_ai_comm(*ai_comm, more_params);
-        ais.push_back(get_ai(_game_idx, _context_options.mcts_options, ai_opt, ai_comm));
+        // Each AI of the game gets its own root noise.
+        mcts_options.seed = _context_options.game_seed(_game_idx, 2 + ais.size());
+        ais.push_back(get_ai(_game_idx, mcts_options, ai_opt, ai_comm));
     }
 
     // std::cout << "Initialize ai" << std::endl;